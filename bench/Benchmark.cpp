@@ -0,0 +1,519 @@
+//============================================================================
+// Name        : Benchmark.cpp
+// Description : Headless benchmark of the SpriteRenderer. Renders reproducible
+//               scenes into plain memory buffers, sweeping over the scene and
+//               renderer parameters, and prints the timings as CSV.
+//
+// Build (from the repository root):
+//   make -C bench
+//
+// Usage: see printUsage, or run benchmark --help.
+//
+// Before measuring, every mode other than "lines" is checked to render the scene,
+// with all sprites moved to the same layer, exactly like the "lines" mode does.
+// RenderCheck.cpp checks all render paths against a scalar reference instead.
+//============================================================================
+
+#include <iostream>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "SpriteRenderer.hpp"
+#include "SpriteBitmap.hpp"
+#include "TaskPool.hpp"
+
+using namespace std;
+using namespace mmo2020;
+using namespace ttlhacker;
+
+
+/**
+ * The frames rendered before measuring, so caches, arenas and cost feedback have settled.
+ */
+constexpr int numWarmupFrames = 3;
+
+/**
+ * The parameters of a single run.
+ */
+struct BenchmarkConfig {
+	int width, height;
+	int numSprites;
+	int maxSpriteSize;
+	double overlapDepth;
+	int numThreads;
+	int numInlineSprites;
+	string mode;
+};
+
+/**
+ * @return The default thread counts: a single thread and all hardware threads, just one on a single core.
+ */
+vector<int> getDefaultThreadCounts() {
+	const int numHardwareThreads = max(1u, thread::hardware_concurrency());
+	return (numHardwareThreads > 1) ? vector<int>{1, numHardwareThreads} : vector<int>{1};
+}
+
+/**
+ * The lists of parameters to sweep over.
+ */
+struct BenchmarkSweep {
+	int numFrames = 50;
+	unsigned seed = 1;
+	vector<int> numSprites{2000};
+	vector<int> maxSpriteSizes{100, 700};
+	vector<double> overlapDepths{0, 8};
+	vector<pair<int, int>> resolutions{{1600, 900}};
+	vector<int> numThreads = getDefaultThreadCounts();
+	vector<int> numInlineSprites{4};
+	vector<string> modes{"lines"};
+};
+
+/**
+ * The sprites of a scene and the area that they move around in.
+ */
+struct BenchmarkScene {
+	vector<Sprite> sprites;
+	IntRectangle<int32_t> area;
+};
+
+
+/**
+ * Makes a scene like the one of the demo: half of the sprites are opaque gradients,
+ * the other half shows parts of a shared bitmap with some translucent texels.
+ * The same config and seed always give the same scene.
+ *
+ * @param config
+ * @param seed
+ * @return
+ */
+BenchmarkScene makeScene(const BenchmarkConfig& config, unsigned seed) {
+	mt19937 gen(seed);
+	uniform_int_distribution<> sizeDistrib(1, config.maxSpriteSize);
+
+	//Shrink the area that the sprites are spread over until they cover each pixel overlapDepth times on average.
+	BenchmarkScene scene;
+	scene.area = IntRectangle<int32_t>(0, 0, config.width, config.height);
+	if (config.overlapDepth > 0) {
+		const double averageSize = (1 + config.maxSpriteSize) / 2.0;
+		const double spriteArea = config.numSprites * averageSize * averageSize;
+		const double scale = min(1.0, sqrt(spriteArea / config.overlapDepth / ((double)config.width * config.height)));
+		scene.area.width = max(1, (int)(config.width * scale));
+		scene.area.height = max(1, (int)(config.height * scale));
+		scene.area.x = (config.width - scene.area.width) / 2;
+		scene.area.y = (config.height - scene.area.height) / 2;
+	}
+	uniform_int_distribution<> xDistrib(scene.area.x, scene.area.getLastX());
+	uniform_int_distribution<> yDistrib(scene.area.y, scene.area.getLastY());
+
+	auto atlas = make_shared<SpriteBitmap>(config.maxSpriteSize, config.maxSpriteSize);
+	for (int y = 0; y < config.maxSpriteSize; y++) {
+		for (int x = 0; x < config.maxSpriteSize; x++) {
+			const uint8_t alpha = ((x / 16 + y / 16) % 4 == 0) ? 128 : 255;
+			atlas->setPixel(x, y, SpritePixel(x * 7, y * 5, (x ^ y) & 0xFF, alpha));
+		}
+	}
+
+	for (int i = 0; i < config.numSprites; i++) {
+		const int spriteWidth = sizeDistrib(gen);
+		const int spriteHeight = sizeDistrib(gen);
+		const IntRectangle<int32_t> position(xDistrib(gen), yDistrib(gen), spriteWidth, spriteHeight);
+
+		if (i % 2) {
+			scene.sprites.emplace_back(position, shared_ptr<const SpriteBitmap>(atlas), 0, 0, i);
+		} else {
+			scene.sprites.emplace_back(position, [=](int x, int y, int count, SpritePixel *pixels) {
+				for (int j = 0; j < count; j++) {
+					pixels[j] = SpritePixel((x + j) * 256 / spriteWidth, y * 256 / spriteHeight, 0);
+				}
+			}, i);
+
+			//The gradients don't have any transparent pixels.
+			scene.sprites.back().isOpaque = true;
+		}
+	}
+
+	return scene;
+}
+
+/**
+ * Moves every sprite one pixel down and to the right, wrapping around within the scene's area.
+ *
+ * @param scene
+ */
+void moveSprites(BenchmarkScene& scene) {
+	for (Sprite& sprite: scene.sprites) {
+		auto& pos = sprite.position;
+		pos.x++;
+		pos.y++;
+		if (pos.x > scene.area.getLastX()) pos.x = scene.area.x;
+		if (pos.y > scene.area.getLastY()) pos.y = scene.area.y;
+	}
+}
+
+/**
+ * @param sortedValues
+ * @param percentile   From 0 to 100.
+ * @return The nearest-rank percentile of the given values.
+ */
+double getPercentile(const vector<double>& sortedValues, double percentile) {
+	if (sortedValues.empty()) {
+		return 0;
+	}
+	size_t rank = (size_t)ceil(percentile / 100 * sortedValues.size());
+	return sortedValues[min(sortedValues.size(), max<size_t>(rank, 1)) - 1];
+}
+
+void printHeader() {
+	cout << "width,height,sprites,max_sprite_size,overlap,threads,inline_sprites,mode,phase,frames,p50_us,p99_us,mean_us,max_us" << endl;
+}
+
+/**
+ * Prints one line of statistics for one phase of a run.
+ *
+ * @param config
+ * @param phase
+ * @param microseconds The time spent in the phase in each frame. Sorted by this function.
+ */
+void printPhase(const BenchmarkConfig& config, const string& phase, vector<double>& microseconds) {
+	sort(microseconds.begin(), microseconds.end());
+
+	double sum = 0;
+	for (double value: microseconds) {
+		sum += value;
+	}
+
+	cout << config.width << ',' << config.height << ','
+		<< config.numSprites << ',' << config.maxSpriteSize << ',' << config.overlapDepth << ','
+		<< config.numThreads << ',' << config.numInlineSprites << ',' << config.mode << ','
+		<< phase << ',' << microseconds.size() << ','
+		<< getPercentile(microseconds, 50) << ',' << getPercentile(microseconds, 99) << ','
+		<< (microseconds.empty() ? 0 : sum / microseconds.size()) << ','
+		<< (microseconds.empty() ? 0 : microseconds.back()) << endl;
+}
+
+/**
+ * Sets up the renderer for the mode of the given config.
+ *
+ * @param renderer
+ * @param config
+ */
+template<typename Renderer>
+void configureRenderer(Renderer& renderer, const BenchmarkConfig& config) {
+	renderer.setTaskPool(make_shared<TaskPool>(config.numThreads, config.mode == "owned"));
+	if (config.mode == "bands") {
+		renderer.setBandHeight(16);
+	} else if (config.mode == "tiles") {
+		renderer.setTileSize(128, 32);
+	} else if (config.mode == "owned") {
+		renderer.setLineOwnership(true);
+	}
+}
+
+/**
+ * Renders one frame of the scene with all sprites on the same layer, in the mode of the
+ * given config and in the "lines" mode, and exits if the two frames aren't byte-identical.
+ * Tiles, bands and line ownership must never change the image, not even for sprites on
+ * the same layer, where only their order in the input decides which one is on top.
+ *
+ * @param config
+ * @param scene
+ */
+template<size_t numInlineSprites>
+void verifyMode(const BenchmarkConfig& config, const BenchmarkScene& scene) {
+	vector<Sprite> sprites = scene.sprites;
+	for (Sprite& sprite: sprites) {
+		sprite.layer = 0;
+	}
+
+	BenchmarkConfig linesConfig = config;
+	linesConfig.mode = "lines";
+
+	vector<uint32_t> frames[2];
+	const BenchmarkConfig *configs[2] = {&config, &linesConfig};
+	for (int i = 0; i < 2; i++) {
+		SpriteRenderer<numInlineSprites, ARGB8888Format> renderer(config.width, config.height);
+		configureRenderer(renderer, *configs[i]);
+		frames[i].assign((size_t)config.width * config.height, 0);
+		renderer.render(sprites, (uint8_t *)frames[i].data(), config.width * sizeof(uint32_t));
+	}
+
+	if (frames[0] != frames[1]) {
+		size_t numDifferent = 0;
+		for (size_t i = 0; i < frames[0].size(); i++) {
+			numDifferent += frames[0][i] != frames[1][i];
+		}
+		cerr << "Mode " << config.mode << " renders " << numDifferent << " pixels differently than lines" << endl;
+		exit(1);
+	}
+}
+
+/**
+ * Renders the scene of the given config for a number of frames and prints the timings:
+ * "frame" is the whole render call, the others are the phases of FramePhase, and
+ * "busiest_thread" is the time that the busiest thread spent in render tasks.
+ *
+ * @param config
+ * @param sweep
+ */
+template<size_t numInlineSprites>
+void runBenchmark(const BenchmarkConfig& config, const BenchmarkSweep& sweep) {
+	BenchmarkScene scene = makeScene(config, sweep.seed);
+	if (config.mode != "lines") {
+		verifyMode<numInlineSprites>(config, scene);
+	}
+
+	SpriteRenderer<numInlineSprites, ARGB8888Format, VectorActiveSet, CollectFrameStats> renderer(config.width, config.height);
+	configureRenderer(renderer, config);
+
+	//Left uninitialized, so clearFramebuffer is the first to touch it.
+	unique_ptr<uint32_t[]> framebuffer(new uint32_t[(size_t)config.width * config.height]);
+	renderer.clearFramebuffer((uint8_t *)framebuffer.get(), config.width * sizeof(uint32_t));
+	vector<double> frameTimes, busiestThreadTimes;
+	vector<double> phaseTimes[numFramePhases];
+
+	for (int frame = 0; frame < numWarmupFrames + sweep.numFrames; frame++) {
+		const auto start = chrono::steady_clock::now();
+		renderer.render(scene.sprites, (uint8_t *)framebuffer.get(), config.width * sizeof(uint32_t));
+		const auto end = chrono::steady_clock::now();
+
+		if (frame >= numWarmupFrames) {
+			const FrameStats& stats = renderer.getFrameStats().getLastFrame();
+			frameTimes.push_back(chrono::duration<double, micro>(end - start).count());
+			for (size_t phase = 0; phase < numFramePhases; phase++) {
+				phaseTimes[phase].push_back(stats.phaseNanos[phase] / 1000.0);
+			}
+
+			uint64_t busiestThreadNanos = 0;
+			for (const ThreadFrameStats& thread: stats.threads) {
+				busiestThreadNanos = max(busiestThreadNanos, thread.taskNanos);
+			}
+			busiestThreadTimes.push_back(busiestThreadNanos / 1000.0);
+		}
+
+		moveSprites(scene);
+	}
+
+	printPhase(config, "frame", frameTimes);
+	for (size_t phase = 0; phase < numFramePhases; phase++) {
+		printPhase(config, getFramePhaseName((FramePhase)phase), phaseTimes[phase]);
+	}
+	printPhase(config, "busiest_thread", busiestThreadTimes);
+
+	//The pinned pool of the owned mode has pinned this thread as its thread 0; the other modes must not inherit that.
+	TaskPool::unpinCallingThread();
+}
+
+/**
+ * Instantiates the renderer for the inline sprite count of the given config.
+ *
+ * @param config
+ * @param sweep
+ */
+void runBenchmark(const BenchmarkConfig& config, const BenchmarkSweep& sweep) {
+	switch (config.numInlineSprites) {
+		case 1:
+			runBenchmark<1>(config, sweep);
+			break;
+		case 2:
+			runBenchmark<2>(config, sweep);
+			break;
+		case 4:
+			runBenchmark<4>(config, sweep);
+			break;
+		case 8:
+			runBenchmark<8>(config, sweep);
+			break;
+		case 16:
+			runBenchmark<16>(config, sweep);
+			break;
+		default:
+			cerr << "Unsupported inline sprite count " << config.numInlineSprites << " (use 1, 2, 4, 8 or 16)" << endl;
+			exit(1);
+	}
+}
+
+void printUsage(ostream& out) {
+	out << "Usage: benchmark [options]\n"
+		"\n"
+		"Each option except --frames and --seed takes a comma-separated list, and every combination is run.\n"
+		"\n"
+		"  --frames N             Frames to measure per run (default 50)\n"
+		"  --seed N               Seed of the random scenes (default 1)\n"
+		"  --sprites 2000,10000   Numbers of sprites\n"
+		"  --sizes 100,700        Maximum widths and heights of the sprites\n"
+		"  --overlap 0,8          Average number of sprites covering each pixel of the area that\n"
+		"                         the sprites are spread over; 0 spreads them over the whole frame\n"
+		"  --resolutions 1600x900 Framebuffer sizes\n"
+		"  --threads 1,8          Threads of the task pool, including the calling thread\n"
+		"  --inline 4,16          Sprites per line before spilling to the heap: 1, 2, 4, 8 or 16\n"
+		"  --modes lines,bands    Rendering modes: lines, bands, tiles, or owned (line by line with\n"
+		"                         pinned threads and line ownership)\n"
+		"  -h, --help             Print this and exit\n";
+}
+
+/**
+ * Prints the given message and the usage to stderr and exits with an error.
+ *
+ * @param message
+ */
+[[noreturn]] void exitWithUsage(const string& message) {
+	cerr << message << endl;
+	printUsage(cerr);
+	exit(1);
+}
+
+/**
+ * Parses a whole number of at least minValue, or exits with the usage.
+ *
+ * @param value
+ * @param minValue
+ * @return
+ */
+int parseInt(const string& value, int minValue) {
+	size_t end = 0;
+	int result = 0;
+	try {
+		result = stoi(value, &end);
+	} catch (const logic_error&) {
+		end = 0;
+	}
+	if (end == 0 || end != value.size() || result < minValue) {
+		exitWithUsage("Expected a whole number of at least " + to_string(minValue) + ", got \"" + value + "\"");
+	}
+	return result;
+}
+
+/**
+ * Parses a number that isn't negative, or exits with the usage.
+ *
+ * @param value
+ * @return
+ */
+double parseNonNegative(const string& value) {
+	size_t end = 0;
+	double result = 0;
+	try {
+		result = stod(value, &end);
+	} catch (const logic_error&) {
+		end = 0;
+	}
+	if (end == 0 || end != value.size() || !(result >= 0)) {
+		exitWithUsage("Expected a number of at least 0, got \"" + value + "\"");
+	}
+	return result;
+}
+
+/**
+ * Splits a comma-separated list and converts each element.
+ *
+ * @param list
+ * @param convert Converts a single element.
+ * @return
+ */
+template<typename T, typename Converter>
+vector<T> parseList(const string& list, Converter convert) {
+	vector<T> values;
+	size_t begin = 0;
+	while (begin <= list.size()) {
+		size_t end = list.find(',', begin);
+		if (end == string::npos) {
+			end = list.size();
+		}
+		values.push_back(convert(list.substr(begin, end - begin)));
+		begin = end + 1;
+	}
+	return values;
+}
+
+pair<int, int> parseResolution(const string& resolution) {
+	const size_t separator = resolution.find('x');
+	if (separator == string::npos) {
+		exitWithUsage("Resolutions must look like 1600x900, got \"" + resolution + "\"");
+	}
+	return {parseInt(resolution.substr(0, separator), 1), parseInt(resolution.substr(separator + 1), 1)};
+}
+
+BenchmarkSweep parseArguments(int argc, char *argv[]) {
+	BenchmarkSweep sweep;
+	auto toCount = [](const string& value) { return parseInt(value, 0); };
+	auto toPositive = [](const string& value) { return parseInt(value, 1); };
+
+	for (int i = 1; i < argc; i++) {
+		const string option = argv[i];
+		if (option == "--help" || option == "-h") {
+			printUsage(cout);
+			exit(0);
+		}
+		if (i + 1 >= argc) {
+			exitWithUsage("Missing value for " + option);
+		}
+		const string value = argv[++i];
+
+		if (option == "--frames") {
+			sweep.numFrames = parseInt(value, 1);
+		} else if (option == "--seed") {
+			sweep.seed = parseInt(value, 0);
+		} else if (option == "--sprites") {
+			sweep.numSprites = parseList<int>(value, toCount);
+		} else if (option == "--sizes") {
+			sweep.maxSpriteSizes = parseList<int>(value, toPositive);
+		} else if (option == "--overlap") {
+			sweep.overlapDepths = parseList<double>(value, parseNonNegative);
+		} else if (option == "--resolutions") {
+			sweep.resolutions = parseList<pair<int, int>>(value, parseResolution);
+		} else if (option == "--threads") {
+			sweep.numThreads = parseList<int>(value, toPositive);
+		} else if (option == "--inline") {
+			sweep.numInlineSprites = parseList<int>(value, [](const string& value) {
+				const int numInlineSprites = parseInt(value, 1);
+				if (numInlineSprites != 1 && numInlineSprites != 2 && numInlineSprites != 4 && numInlineSprites != 8 && numInlineSprites != 16) {
+					exitWithUsage("Inline sprite counts must be 1, 2, 4, 8 or 16, got " + value);
+				}
+				return numInlineSprites;
+			});
+		} else if (option == "--modes") {
+			sweep.modes = parseList<string>(value, [](const string& value) {
+				if (value != "lines" && value != "bands" && value != "tiles" && value != "owned") {
+					exitWithUsage("Modes must be lines, bands, tiles or owned, got " + value);
+				}
+				return value;
+			});
+		} else {
+			exitWithUsage("Unknown option " + option);
+		}
+	}
+
+	return sweep;
+}
+
+
+int main(int argc, char *argv[]) {
+	const BenchmarkSweep sweep = parseArguments(argc, argv);
+
+	printHeader();
+	for (const auto& resolution: sweep.resolutions) {
+		for (int numSprites: sweep.numSprites) {
+			for (int maxSpriteSize: sweep.maxSpriteSizes) {
+				for (double overlapDepth: sweep.overlapDepths) {
+					for (int numThreads: sweep.numThreads) {
+						for (int numInlineSprites: sweep.numInlineSprites) {
+							for (const string& mode: sweep.modes) {
+								BenchmarkConfig config{resolution.first, resolution.second, numSprites, maxSpriteSize, overlapDepth, numThreads, numInlineSprites, mode};
+								runBenchmark(config, sweep);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,571 @@
+//============================================================================
+// Name        : RenderCheck.cpp
+// Description : Headless check of the SpriteRenderer. Renders random scenes through
+//               all render paths and compares every pixel with a scalar reference,
+//               which composites the sprites of each pixel one by one, front to back,
+//               with SpriteInstance::getPixel and compositePixelBelow. Every path must
+//               match it exactly, so neither the vectorized kernels nor the ways of
+//               splitting up a frame may change a single pixel.
+//
+// Build and run (from the repository root):
+//   make -C bench check
+//
+// Prints each check and exits with 1 if any of them fails.
+//============================================================================
+
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+#include "SpriteRenderer.hpp"
+#include "SpriteBitmap.hpp"
+#include "RunLengthBitmap.hpp"
+#include "SpriteScene.hpp"
+#include "BatchRenderer.hpp"
+#include "TaskPool.hpp"
+
+using namespace std;
+using namespace mmo2020;
+using namespace ttlhacker;
+
+
+constexpr int frameWidth = 320, frameHeight = 200;
+
+/**
+ * The size of the background image, large enough for every framebuffer of the checks.
+ */
+constexpr int imageSize = 512;
+
+/**
+ * Packed ARGB8888 pixels, line after line without padding.
+ */
+using Frame = vector<uint32_t>;
+
+/**
+ * What lies behind the sprites, for the renderer and for the reference.
+ */
+struct CheckBackground {
+	string name;
+	BackgroundMode mode;
+	SpritePixel color;
+
+	/**
+	 * imageSize x imageSize packed pixels, for BackgroundMode::Image.
+	 */
+	const Frame *image;
+
+	/**
+	 * What the framebuffer contains before rendering, for BackgroundMode::Untouched.
+	 */
+	uint32_t fill;
+};
+
+/**
+ * How a renderer splits up the frame, see configureMode.
+ */
+struct CheckMode {
+	string name;
+	int numThreads;
+	int bandHeight;
+	int tileWidth, tileHeight;
+	bool lineOwnership;
+};
+
+/**
+ * True once any check failed.
+ */
+bool failed = false;
+
+
+/**
+ * Makes sprites of all kinds of sources, sizes, layers, opacities and blend modes,
+ * spread over the given area and a bit beyond.
+ *
+ * @param gen
+ * @param area
+ * @param numSprites
+ * @return
+ */
+vector<Sprite> makeSprites(mt19937& gen, const IntRectangle<int32_t>& area, int numSprites) {
+	static const auto atlas = make_shared<SpriteBitmap>(128, 128, [](int x, int y) {
+		const uint8_t alpha = ((x / 8 + y / 8) % 3 == 0) ? (x * 2) & 0xFF : 255;
+		return SpritePixel(x * 7, y * 5, (x ^ y) & 0xFF, alpha);
+	});
+	static const auto runLengthBitmap = make_shared<RunLengthBitmap>(64, 64, [](int x, int y) {
+		return ((x - 32) * (x - 32) + (y - 32) * (y - 32) < 900) ? SpritePixel(200, x * 4, y * 4, (x % 16 < 12) ? 255 : 90) : SpritePixel();
+	});
+
+	uniform_int_distribution<> sizeDistrib(1, 90);
+	uniform_int_distribution<> xDistrib(area.x - 40, area.getLastX());
+	uniform_int_distribution<> yDistrib(area.y - 40, area.getLastY());
+	uniform_int_distribution<> byteDistrib(0, 255);
+	uniform_int_distribution<> layerDistrib(0, 3);
+	uniform_int_distribution<> percentDistrib(0, 99);
+
+	vector<Sprite> sprites;
+	for (int i = 0; i < numSprites; i++) {
+		const int width = sizeDistrib(gen);
+		const int height = sizeDistrib(gen);
+		const IntRectangle<int32_t> position(xDistrib(gen), yDistrib(gen), width, height);
+		const uint32_t layer = layerDistrib(gen);
+		const uint8_t seed = byteDistrib(gen);
+
+		switch (i % 8) {
+			case 0:
+				sprites.emplace_back(IntRectangle<int32_t>(position.x, position.y, min(width, 64), min(height, 64)), atlas, seed % 64, (seed * 3) % 64, layer);
+				break;
+			case 1:
+				sprites.emplace_back(position, Sprite::PixelGetter([=](int x, int y) {
+					return SpritePixel(x * 3 + seed, y * 3, seed, (x + y) % 4 ? 255 : seed);
+				}), layer);
+				break;
+			case 2:
+				sprites.emplace_back(position, Sprite::SpanGetter([=](int x, int y, int count, SpritePixel *pixels) {
+					for (int j = 0; j < count; j++) {
+						pixels[j] = SpritePixel((x + j) * 256 / width, y * 256 / height, seed);
+					}
+				}), layer);
+				sprites.back().isOpaque = true;
+				break;
+			case 3:
+				sprites.emplace_back(position, SpritePixel(seed, 255 - seed, 128, (seed % 2) ? 255 : seed), layer);
+				break;
+			case 4:
+				sprites.emplace_back(IntRectangle<int32_t>(position.x, position.y, min(width, 64), min(height, 64)), runLengthBitmap, layer);
+				break;
+			case 5:
+				sprites.emplace_back(position, atlas, IntRectangle<int32_t>(seed % 64, seed / 4, 1 + seed % 60, 1 + seed / 5), layer);
+				sprites.back().flipX = seed % 2;
+				sprites.back().flipY = seed % 3 == 0;
+				break;
+			case 6:
+				sprites.emplace_back(position, Sprite::PixelGetter([=](int x, int y) {
+					return SpritePixel(x * 9, y * 9, seed, 160 + (x % 3) * 40);
+				}), layer);
+				sprites.back().sourceRect = IntRectangle<int32_t>(0, 0, 1 + seed % 30, 1 + seed % 20);
+				break;
+			default:
+				sprites.emplace_back(position, Sprite::SpanGetter([=](int x, int y, int count, SpritePixel *pixels) {
+					for (int j = 0; j < count; j++) {
+						pixels[j] = SpritePixel(seed, (x + j) * 5, y * 5, ((x + j) / 4) % 2 ? 255 : 60);
+					}
+				}), layer);
+				sprites.back().flipX = true;
+				break;
+		}
+
+		const int percent = percentDistrib(gen);
+		if (percent < 15) {
+			sprites.back().opacity = byteDistrib(gen);
+		}
+		if (percent >= 80) {
+			sprites.back().blendMode = (percent >= 90) ? BlendMode::Additive : BlendMode::Multiply;
+		}
+	}
+	return sprites;
+}
+
+/**
+ * Renders the given sprites one pixel at a time: composites the sprites covering each
+ * pixel front to back until nothing shines through anymore, then the background.
+ *
+ * @param instances  The sprites, in the coordinates of the area.
+ * @param area       The part of the sprites' coordinates to render. Its top left corner ends up in the top left corner of the frame.
+ * @param background
+ * @param frame      area.width x area.height pixels, already holding what BackgroundMode::Untouched keeps.
+ */
+void renderReference(vector<SpriteInstance> instances, const IntRectangle<int32_t>& area, const CheckBackground& background, Frame& frame) {
+	sort(instances.begin(), instances.end(), [](const SpriteInstance& a, const SpriteInstance& b) {
+		return a.getDepth() > b.getDepth();
+	});
+
+	for (int y = 0; y < (int)area.height; y++) {
+		for (int x = 0; x < (int)area.width; x++) {
+			const int32_t sceneX = area.x + x, sceneY = area.y + y;
+			uint32_t& pixel = frame[(size_t)y * area.width + x];
+
+			SpritePixel accumulated(0, 0, 0, 0);
+			uint32_t transmittance = fullTransmittance;
+			bool isCovered = false;
+			for (const SpriteInstance& instance: instances) {
+				if (transmittance == 0) {
+					break;
+				}
+				const IntRectangle<int32_t>& position = instance.position;
+				if (sceneX < position.x || sceneX > position.getLastX() || sceneY < position.y || sceneY > position.getLastY()) {
+					continue;
+				}
+
+				isCovered = true;
+				const SpritePixel src = instance.getPixel(sceneX - position.x, sceneY - position.y);
+				switch (instance.blendMode) {
+					case BlendMode::Normal:
+						compositePixelBelow<BlendMode::Normal>(src, instance.opacity, accumulated, transmittance);
+						break;
+					case BlendMode::Additive:
+						compositePixelBelow<BlendMode::Additive>(src, instance.opacity, accumulated, transmittance);
+						break;
+					case BlendMode::Multiply:
+						compositePixelBelow<BlendMode::Multiply>(src, instance.opacity, accumulated, transmittance);
+						break;
+				}
+			}
+
+			if (!isCovered) {
+				//The background is left as it is.
+				if (background.mode == BackgroundMode::Color) {
+					pixel = ARGB8888Format::pack(background.color.r, background.color.g, background.color.b);
+				} else if (background.mode == BackgroundMode::Image) {
+					pixel = (*background.image)[(size_t)y * imageSize + x];
+				}
+				continue;
+			}
+
+			if (transmittance != 0) {
+				SpritePixel below = background.color;
+				if (background.mode != BackgroundMode::Color) {
+					const uint32_t packed = (background.mode == BackgroundMode::Image) ? (*background.image)[(size_t)y * imageSize + x] : pixel;
+					below = ARGB8888Format::unpack((const uint8_t *)&packed);
+				}
+				compositePixelBelow<BlendMode::Normal>(below, 0xFF, accumulated, transmittance);
+			}
+			pixel = ARGB8888Format::pack(accumulated.r, accumulated.g, accumulated.b);
+		}
+	}
+}
+
+/**
+ * @param sprites
+ * @return The instances of the given sprites, ordered as in render(const vector<Sprite>&, ...).
+ */
+vector<SpriteInstance> toInstances(const vector<Sprite>& sprites) {
+	vector<SpriteInstance> instances;
+	for (size_t i = 0; i < sprites.size(); i++) {
+		instances.emplace_back(sprites[i], i);
+	}
+	return instances;
+}
+
+/**
+ * @param scene
+ * @return The instances of the sprites of the given scene, ordered by their slots.
+ */
+vector<SpriteInstance> toInstances(const SpriteScene& scene) {
+	vector<SpriteInstance> instances;
+	for (uint32_t slot = 0; slot < scene.getSlotCount(); slot++) {
+		if (const Sprite *sprite = scene.getSpriteInSlot(slot)) {
+			instances.emplace_back(*sprite, slot);
+		}
+	}
+	return instances;
+}
+
+/**
+ * @param width
+ * @param height
+ * @param background
+ * @return A frame as the renderer should find it, see CheckBackground::fill.
+ */
+Frame makeFrame(int width, int height, const CheckBackground& background) {
+	return Frame((size_t)width * height, background.fill);
+}
+
+/**
+ * Prints the result of a check and remembers if it failed.
+ *
+ * @param name
+ * @param actual
+ * @param expected
+ * @param width    The width of both frames.
+ */
+void compareFrames(const string& name, const Frame& actual, const Frame& expected, int width) {
+	size_t numDifferent = 0, firstDifferent = 0;
+	for (size_t i = actual.size(); i-- > 0;) {
+		if (actual[i] != expected[i]) {
+			numDifferent++;
+			firstDifferent = i;
+		}
+	}
+
+	if (numDifferent == 0) {
+		cout << "ok   " << name << endl;
+		return;
+	}
+
+	failed = true;
+	cout << "FAIL " << name << ": " << numDifferent << " pixels differ, the first at (" << firstDifferent % width << ", " << firstDifferent / width
+		<< ") is " << hex << setw(8) << setfill('0') << actual[firstDifferent] << " instead of " << setw(8) << expected[firstDifferent] << dec << endl;
+}
+
+/**
+ * Sets up a renderer for the given mode.
+ *
+ * @param renderer
+ * @param mode
+ */
+template<typename Renderer>
+void configureMode(Renderer& renderer, const CheckMode& mode) {
+	renderer.setTaskPool(make_shared<TaskPool>(mode.numThreads));
+	if (mode.bandHeight) {
+		renderer.setBandHeight(mode.bandHeight);
+	}
+	if (mode.tileWidth) {
+		renderer.setTileSize(mode.tileWidth, mode.tileHeight);
+	}
+	renderer.setLineOwnership(mode.lineOwnership);
+}
+
+/**
+ * Sets up the background of a renderer.
+ *
+ * @param renderer
+ * @param background
+ */
+template<typename Renderer>
+void applyBackground(Renderer& renderer, const CheckBackground& background) {
+	switch (background.mode) {
+		case BackgroundMode::Color:
+			renderer.setBackgroundColor(background.color);
+			break;
+		case BackgroundMode::Image:
+			renderer.setBackgroundImage((const uint8_t *)background.image->data(), imageSize * sizeof(uint32_t));
+			break;
+		case BackgroundMode::Untouched:
+			renderer.setBackgroundUntouched();
+			break;
+	}
+}
+
+/**
+ * Checks render(const vector<Sprite>&, ...) and renderAsync with the given renderer type.
+ *
+ * @param prefix      Describes the renderer type.
+ * @param sprites
+ * @param modes
+ * @param backgrounds
+ */
+template<typename Renderer>
+void checkSpriteVector(const string& prefix, const vector<Sprite>& sprites, const vector<CheckMode>& modes, const vector<CheckBackground>& backgrounds) {
+	const IntRectangle<int32_t> area(0, 0, frameWidth, frameHeight);
+	const size_t pitch = frameWidth * sizeof(uint32_t);
+
+	for (const CheckBackground& background: backgrounds) {
+		Frame expected = makeFrame(frameWidth, frameHeight, background);
+		renderReference(toInstances(sprites), area, background, expected);
+
+		for (const CheckMode& mode: modes) {
+			Renderer renderer(frameWidth, frameHeight);
+			configureMode(renderer, mode);
+			applyBackground(renderer, background);
+
+			Frame frame = makeFrame(frameWidth, frameHeight, background);
+			renderer.render(sprites, (uint8_t *)frame.data(), pitch);
+			compareFrames(prefix + " render " + mode.name + " " + background.name, frame, expected, frameWidth);
+
+			frame = makeFrame(frameWidth, frameHeight, background);
+			renderer.renderAsync(sprites, (uint8_t *)frame.data(), pitch).get();
+			compareFrames(prefix + " renderAsync " + mode.name + " " + background.name, frame, expected, frameWidth);
+		}
+	}
+}
+
+int main() {
+	mt19937 gen(1);
+	const IntRectangle<int32_t> frameArea(0, 0, frameWidth, frameHeight);
+	const size_t pitch = frameWidth * sizeof(uint32_t);
+
+	Frame image((size_t)imageSize * imageSize);
+	for (size_t i = 0; i < image.size(); i++) {
+		image[i] = 0xFF000000 | (uint32_t)(i * 2654435761u >> 8);
+	}
+
+	const vector<CheckBackground> backgrounds{
+		{"black", BackgroundMode::Color, SpritePixel(0, 0, 0), nullptr, 0},
+		{"color", BackgroundMode::Color, SpritePixel(30, 90, 150), nullptr, 0},
+		{"image", BackgroundMode::Image, SpritePixel(0, 0, 0), &image, 0},
+		{"untouched", BackgroundMode::Untouched, SpritePixel(0, 0, 0), nullptr, 0xFF406080}
+	};
+	const vector<CheckBackground> streamingBackgrounds(backgrounds.begin(), backgrounds.end() - 1);
+
+	const vector<CheckMode> modes{
+		{"lines", 3, 0, 0, 0, false},
+		{"bands", 3, 16, 0, 0, false},
+		{"tiles", 3, 0, 64, 32, false},
+		{"owned", 3, 0, 0, 0, true},
+		{"single", 1, 0, 0, 0, false}
+	};
+
+	const vector<Sprite> sprites = makeSprites(gen, frameArea, 400);
+	checkSpriteVector<SpriteRenderer<4, ARGB8888Format>>("vector", sprites, modes, backgrounds);
+	checkSpriteVector<SpriteRenderer<4, ARGB8888Format, OrderedActiveSet>>("ordered", sprites, modes, backgrounds);
+	checkSpriteVector<SpriteRenderer<1, ARGB8888Format>>("spilled", sprites, modes, backgrounds);
+
+	//Streaming, in bands that don't divide the frame evenly.
+	for (const CheckBackground& background: streamingBackgrounds) {
+		Frame expected = makeFrame(frameWidth, frameHeight, background);
+		renderReference(toInstances(sprites), frameArea, background, expected);
+
+		SpriteRenderer<4, ARGB8888Format> renderer(frameWidth, frameHeight);
+		renderer.setTaskPool(make_shared<TaskPool>(3));
+		applyBackground(renderer, background);
+		Frame frame = makeFrame(frameWidth, frameHeight, background);
+		renderer.renderStreaming(sprites, 7, [&](const uint8_t *pixels, size_t bandPitch, int firstY, int numLines) {
+			for (int y = 0; y < numLines; y++) {
+				memcpy(&frame[(size_t)(firstY + y) * frameWidth], pixels + y * bandPitch, pitch);
+			}
+		});
+		compareFrames("renderStreaming " + background.name, frame, expected, frameWidth);
+	}
+
+	//A scene that changes from frame to frame, rendered in full and only where it changed.
+	SpriteScene scene;
+	vector<SpriteHandle> handles;
+	for (Sprite& sprite: makeSprites(gen, frameArea, 300)) {
+		handles.push_back(scene.addSprite(move(sprite)));
+	}
+	const vector<CheckBackground> dirtyBackgrounds{backgrounds[0], backgrounds[1], backgrounds[2]};
+	for (const CheckBackground& background: dirtyBackgrounds) {
+		for (const CheckMode& mode: modes) {
+			SpriteRenderer<4, ARGB8888Format> fullRenderer(frameWidth, frameHeight), dirtyRenderer(frameWidth, frameHeight);
+			configureMode(fullRenderer, mode);
+			configureMode(dirtyRenderer, mode);
+			applyBackground(fullRenderer, background);
+			applyBackground(dirtyRenderer, background);
+
+			SpriteScene changingScene = scene;
+			vector<SpriteHandle> changingHandles = handles;
+			Frame dirtyFrame = makeFrame(frameWidth, frameHeight, background);
+			mt19937 changeGen(2);
+			uniform_int_distribution<size_t> handleDistrib(0, changingHandles.size() - 1);
+			uniform_int_distribution<> moveDistrib(-5, 5);
+
+			for (int frameIndex = 0; frameIndex < 4; frameIndex++) {
+				Frame expected = makeFrame(frameWidth, frameHeight, background);
+				renderReference(toInstances(changingScene), frameArea, background, expected);
+
+				Frame frame = makeFrame(frameWidth, frameHeight, background);
+				fullRenderer.render(changingScene, (uint8_t *)frame.data(), pitch);
+				compareFrames("scene " + mode.name + " " + background.name + " frame " + to_string(frameIndex), frame, expected, frameWidth);
+
+				dirtyRenderer.renderDirty(changingScene, (uint8_t *)dirtyFrame.data(), pitch);
+				compareFrames("renderDirty " + mode.name + " " + background.name + " frame " + to_string(frameIndex), dirtyFrame, expected, frameWidth);
+
+				//Move, restack, remove and add a few sprites.
+				for (int i = 0; i < 10; i++) {
+					SpriteHandle& handle = changingHandles[handleDistrib(changeGen)];
+					if (!changingScene.isValid(handle)) {
+						continue;
+					}
+					const Sprite& sprite = changingScene.getSprite(handle);
+					switch (i % 4) {
+						case 0:
+						case 1:
+							changingScene.moveSprite(handle, sprite.position.x + moveDistrib(changeGen), sprite.position.y + moveDistrib(changeGen));
+							break;
+						case 2: {
+							Sprite restacked = sprite;
+							restacked.layer = (restacked.layer + 1) % 4;
+							changingScene.updateSprite(handle, move(restacked));
+							break;
+						}
+						default:
+							changingScene.removeSprite(handle);
+							handle = changingScene.addSprite(makeSprites(changeGen, frameArea, 8)[changeGen() % 8]);
+							break;
+					}
+				}
+			}
+		}
+	}
+
+	//Cameras anywhere over the scene, with and without a spatial index.
+	SpriteScene indexedScene = scene;
+	indexedScene.enableSpatialIndex(64);
+	const pair<int32_t, int32_t> cameras[] = {{0, 0}, {-37, 21}, {150, -60}, {frameWidth - 1, frameHeight - 1}};
+	for (const CheckMode& mode: modes) {
+		for (const SpriteScene *cameraScene: {&scene, &indexedScene}) {
+			SpriteRenderer<4, ARGB8888Format> renderer(frameWidth, frameHeight);
+			configureMode(renderer, mode);
+			applyBackground(renderer, backgrounds[1]);
+			for (const auto& camera: cameras) {
+				Frame expected = makeFrame(frameWidth, frameHeight, backgrounds[1]);
+				renderReference(toInstances(*cameraScene), IntRectangle<int32_t>(camera.first, camera.second, frameWidth, frameHeight), backgrounds[1], expected);
+
+				Frame frame = makeFrame(frameWidth, frameHeight, backgrounds[1]);
+				renderer.render(*cameraScene, (uint8_t *)frame.data(), pitch, camera.first, camera.second);
+				compareFrames("camera " + mode.name + (cameraScene == &indexedScene ? " indexed" : "") + " at " + to_string(camera.first) + "," + to_string(camera.second),
+					frame, expected, frameWidth);
+			}
+		}
+	}
+
+	//Overlapping viewports of other sizes than the renderer.
+	const IntRectangle<int32_t> viewportAreas[] = {{-20, -10, 200, 150}, {100, 50, 400, 120}, {10, 10, 33, 17}};
+	for (const CheckBackground& background: backgrounds) {
+		for (const CheckMode& mode: modes) {
+			SpriteRenderer<4, ARGB8888Format> renderer(frameWidth, frameHeight);
+			configureMode(renderer, mode);
+			applyBackground(renderer, background);
+
+			vector<Frame> frames;
+			vector<Viewport> viewports;
+			for (const IntRectangle<int32_t>& viewportArea: viewportAreas) {
+				frames.push_back(makeFrame(viewportArea.width, viewportArea.height, background));
+			}
+			for (size_t i = 0; i < frames.size(); i++) {
+				viewports.push_back(Viewport{viewportAreas[i], (uint8_t *)frames[i].data(), viewportAreas[i].width * sizeof(uint32_t)});
+			}
+			renderer.render(scene, viewports);
+
+			for (size_t i = 0; i < frames.size(); i++) {
+				Frame expected = makeFrame(viewportAreas[i].width, viewportAreas[i].height, background);
+				renderReference(toInstances(scene), viewportAreas[i], background, expected);
+				compareFrames("viewport " + to_string(i) + " " + mode.name + " " + background.name, frames[i], expected, viewportAreas[i].width);
+			}
+		}
+	}
+
+	//Many small frames, each rendered by one thread.
+	BatchRenderer<SpriteRenderer<4, ARGB8888Format>> batchRenderer;
+	batchRenderer.setTaskPool(make_shared<TaskPool>(3));
+	vector<IntRectangle<int32_t>> jobAreas;
+	for (int i = 0; i < 24; i++) {
+		jobAreas.emplace_back(i * 13 - 30, (i * 29) % frameHeight - 20, 16 + i * 3, 8 + (i * 7) % 40);
+	}
+	for (int batch = 0; batch < 2; batch++) {
+		vector<Frame> frames;
+		vector<BatchJob> jobs;
+		for (const IntRectangle<int32_t>& jobArea: jobAreas) {
+			frames.push_back(makeFrame(jobArea.width, jobArea.height, backgrounds[0]));
+		}
+		for (size_t i = 0; i < frames.size(); i++) {
+			jobs.push_back(BatchJob{&scene, Viewport{jobAreas[i], (uint8_t *)frames[i].data(), jobAreas[i].width * sizeof(uint32_t)}});
+		}
+		batchRenderer.render(jobs);
+
+		Frame expected;
+		size_t numFailedJobs = 0;
+		for (size_t i = 0; i < frames.size(); i++) {
+			expected = makeFrame(jobAreas[i].width, jobAreas[i].height, backgrounds[0]);
+			renderReference(toInstances(scene), jobAreas[i], backgrounds[0], expected);
+			numFailedJobs += frames[i] != expected;
+			if (frames[i] != expected) {
+				compareFrames("batch " + to_string(batch) + " job " + to_string(i), frames[i], expected, jobAreas[i].width);
+			}
+		}
+		if (numFailedJobs == 0) {
+			cout << "ok   batch " << batch << " (" << jobs.size() << " jobs)" << endl;
+		}
+	}
+
+	if (failed) {
+		cout << "Some frames differ from the reference" << endl;
+		return 1;
+	}
+	cout << "All frames match the reference" << endl;
+	return 0;
+}
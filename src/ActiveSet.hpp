@@ -0,0 +1,276 @@
+/*
+ * ActiveSet.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef ACTIVESET_HPP_
+#define ACTIVESET_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <functional>
+
+#include "Arena.hpp"
+#include "Sprite.hpp"
+
+using namespace std;
+using namespace ttlhacker;
+
+namespace mmo2020 {
+
+
+/*
+ * Active set policies for SpriteRenderer. An active set holds the sprites that are active
+ * at the current X coordinate while rendering a line, ordered by depth (layer, then order,
+ * see SpriteInstance::getDepth). All of them
+ * provide the following:
+ *
+ * explicit ActiveSet(Arena& arena)
+ *     Creates an empty set that allocates its memory from the given arena.
+ *
+ * template<typename EventIterator> void insert(EventIterator first, EventIterator last)
+ *     Inserts the sprites of the given range of events. The events have a sprite member
+ *     and are sorted by the sprites' depths. Where the sprites end up doesn't depend on
+ *     when they are inserted.
+ *
+ * size_t removeInactive(int x)
+ *     Removes all sprites that end before the given X coordinate and returns the number
+ *     of removed sprites that are known to be opaque.
+ *
+ * begin(), end()
+ *     Iterators over the sprites, from the topmost to the bottommost one. Dereferencing
+ *     yields a const SpriteInstance *. May include sprites that have already ended.
+ */
+
+
+/**
+ * Keeps the active sprites in a vector sorted by depth. Inserting merges the new sprites in,
+ * removing is a linear pass over all sprites. Fastest for the usual handful of sprites per pixel.
+ */
+class VectorActiveSet {
+private:
+	using SpriteStack = vector<const SpriteInstance *, ArenaAllocator<const SpriteInstance *>>;
+
+	/**
+	 * Sorted so that the topmost sprite (the one with the largest Z coordinate) is last.
+	 */
+	SpriteStack spriteStack;
+
+public:
+	using const_iterator = SpriteStack::const_reverse_iterator;
+
+	explicit VectorActiveSet(Arena& arena):
+		spriteStack(ArenaAllocator<const SpriteInstance *>(&arena))
+	{
+		spriteStack.reserve(16);
+	}
+
+	template<typename EventIterator>
+	void insert(EventIterator first, EventIterator last) {
+		const size_t nSpritesToInsert = last - first;
+		if (nSpritesToInsert == 0) return;
+
+		//Turns out inplace_merge is slower than this homegrown monstrosity below.
+
+		//If the stack is empty, just insert the sorted elements directly and be done.
+		//The loop below can't merge into an empty vector.
+		size_t previousSize = spriteStack.size();
+		if (previousSize == 0) {
+			for (EventIterator event = first; event != last; event++) {
+				spriteStack.push_back(event->sprite);
+			}
+			return;
+		}
+
+		//Append as many nullptrs to the vector as elements that we need to insert.
+		spriteStack.resize(previousSize + nSpritesToInsert, nullptr);
+
+		//Finally merge the new sprites into the spriteStack.
+		auto previousContentIter = spriteStack.begin() + (previousSize - 1);
+		auto writeIter = spriteStack.end();
+		EventIterator spritesToInsertIter = last - 1;
+
+		bool startOfSpriteStackReached = false;
+		while (true) {
+			writeIter--;
+			const SpriteInstance *spriteToInsert = spritesToInsertIter->sprite;
+
+			//We can insert directly at the write position if there's either no elements of the previous stack content left,
+			//or if we sort before the largest element of the previous stack content that's still left.
+			bool insertHere = startOfSpriteStackReached || (spriteToInsert->getDepth() > (*previousContentIter)->getDepth());
+
+			if (insertHere) {
+				//Consume one of the new sprites to merge in.
+				*writeIter = spriteToInsert;
+				if (spritesToInsertIter == first) {
+					//We just inserted the last sprite and are now done.
+					break;
+				}
+				spritesToInsertIter--;
+			} else {
+				//Move one of the old sprites forward within the vector.
+				*writeIter = *previousContentIter;
+				*previousContentIter = nullptr;
+				if (previousContentIter == spriteStack.begin()) {
+					//No more old sprites left to move over; from now on, just insert everything.
+					startOfSpriteStackReached = true;
+				} else {
+					previousContentIter--;
+				}
+			}
+		}
+	}
+
+	size_t removeInactive(int x) {
+		size_t nOpaqueSprites = 0;
+		spriteStack.erase(
+				remove_if(
+						spriteStack.begin(),
+						spriteStack.end(),
+						[&](const SpriteInstance *sprite) {
+							bool isInactive = x > sprite->position.getLastX();
+							nOpaqueSprites += isInactive && sprite->isOpaque;
+							return isInactive;
+						}),
+				spriteStack.end());
+		return nOpaqueSprites;
+	}
+
+	const_iterator begin() const {
+		return spriteStack.rbegin();
+	}
+
+	const_iterator end() const {
+		return spriteStack.rend();
+	}
+};
+
+
+/**
+ * Keeps the active sprites in a balanced tree ordered by depth, and their end coordinates in
+ * a min-heap. Inserting a sprite takes O(log n), and so does removing one once it has ended,
+ * without looking at any of the other sprites. Pays off with hundreds of sprites on a line.
+ */
+class OrderedActiveSet {
+private:
+	struct Entry {
+		/**
+		 * Copy of the sprite's depth.
+		 */
+		uint64_t depth;
+
+		const SpriteInstance *sprite;
+	};
+
+	/**
+	 * Sorts the bottommost sprite first.
+	 */
+	struct EntryOrder {
+		bool operator()(const Entry& a, const Entry& b) const {
+			return a.depth < b.depth;
+		}
+	};
+
+	using EntrySet = set<Entry, EntryOrder, ArenaAllocator<Entry>>;
+
+	struct Expiry {
+		int32_t lastX;
+		EntrySet::const_iterator entry;
+
+		/**
+		 * Makes the heap a min-heap.
+		 */
+		bool operator<(const Expiry& other) const {
+			return lastX > other.lastX;
+		}
+	};
+
+	EntrySet entries;
+	vector<Expiry, ArenaAllocator<Expiry>> expiries;
+
+public:
+	/**
+	 * Iterates from the topmost sprite down and yields the sprites themselves.
+	 */
+	class const_iterator {
+	private:
+		EntrySet::const_reverse_iterator it;
+
+	public:
+		const_iterator(EntrySet::const_reverse_iterator it):
+			it(it)
+		{
+			//Nothing else to initialize
+		}
+
+		const SpriteInstance * operator*() const {
+			return it->sprite;
+		}
+
+		const_iterator& operator++() {
+			++it;
+			return *this;
+		}
+
+		const_iterator operator++(int) {
+			const_iterator previous = *this;
+			++it;
+			return previous;
+		}
+
+		bool operator==(const const_iterator& other) const {
+			return it == other.it;
+		}
+
+		bool operator!=(const const_iterator& other) const {
+			return it != other.it;
+		}
+	};
+
+	explicit OrderedActiveSet(Arena& arena):
+		entries(EntryOrder(), ArenaAllocator<Entry>(&arena)), expiries(ArenaAllocator<Expiry>(&arena))
+	{
+		//Nothing else to initialize
+	}
+
+	template<typename EventIterator>
+	void insert(EventIterator first, EventIterator last) {
+		for (EventIterator event = first; event != last; event++) {
+			const SpriteInstance *sprite = event->sprite;
+			auto entry = entries.insert(Entry{sprite->getDepth(), sprite}).first;
+
+			expiries.push_back(Expiry{sprite->position.getLastX(), entry});
+			push_heap(expiries.begin(), expiries.end());
+		}
+	}
+
+	size_t removeInactive(int x) {
+		size_t nOpaqueSprites = 0;
+		while (!expiries.empty() && expiries.front().lastX < x) {
+			nOpaqueSprites += expiries.front().entry->sprite->isOpaque;
+			entries.erase(expiries.front().entry);
+
+			pop_heap(expiries.begin(), expiries.end());
+			expiries.pop_back();
+		}
+		return nOpaqueSprites;
+	}
+
+	const_iterator begin() const {
+		return const_iterator(entries.rbegin());
+	}
+
+	const_iterator end() const {
+		return const_iterator(entries.rend());
+	}
+};
+
+
+}
+
+
+#endif /* ACTIVESET_HPP_ */
@@ -0,0 +1,210 @@
+/*
+ * Arena.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef ARENA_HPP_
+#define ARENA_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <new>
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+namespace ttlhacker {
+
+
+/**
+ * A bump allocator for short-lived memory. Allocating just advances a pointer,
+ * and all memory is freed at once by resetting the arena. The arena keeps its
+ * memory after a reset, so once it has grown large enough, allocating from it
+ * doesn't touch the heap anymore.
+ *
+ * Not thread-safe. Objects allocated in the arena are never destroyed by it.
+ */
+class Arena {
+private:
+	struct Block {
+		unique_ptr<uint8_t[]> memory;
+		size_t size;
+	};
+
+	static constexpr size_t minBlockSize = 64 * 1024;
+
+	vector<Block> blocks;
+
+	/**
+	 * The block that is currently allocated from, and the number of bytes used in it.
+	 */
+	size_t currentBlock = 0;
+	size_t currentOffset = 0;
+
+	void addBlock(size_t size) {
+		blocks.push_back(Block{unique_ptr<uint8_t[]>(new uint8_t[size]), size});
+	}
+
+public:
+	/**
+	 * A position within the arena to go back to later, see getMarker and rewind.
+	 */
+	struct Marker {
+		size_t block;
+		size_t offset;
+	};
+
+	Arena() = default;
+	Arena(Arena&&) = default;
+	Arena& operator=(Arena&&) = default;
+
+	/**
+	 * Allocates uninitialized memory.
+	 *
+	 * @param size
+	 * @param alignment Must be a power of two.
+	 * @return The allocated memory. Stays valid until the arena is reset or rewound past it.
+	 */
+	void * allocate(size_t size, size_t alignment) {
+		assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+
+		while (true) {
+			if (currentBlock < blocks.size()) {
+				Block& block = blocks[currentBlock];
+				const uintptr_t base = (uintptr_t)block.memory.get();
+				const uintptr_t aligned = (base + currentOffset + alignment - 1) & ~(uintptr_t)(alignment - 1);
+				const size_t end = (aligned - base) + size;
+				if (end <= block.size) {
+					currentOffset = end;
+					return (void *)aligned;
+				}
+
+				//Doesn't fit anymore, try the next block.
+				currentBlock++;
+				currentOffset = 0;
+				continue;
+			}
+
+			//Out of blocks. Grow geometrically so the number of blocks stays small.
+			size_t newBlockSize = max(minBlockSize, size + alignment);
+			if (!blocks.empty()) {
+				newBlockSize = max(newBlockSize, 2 * blocks.back().size);
+			}
+			addBlock(newBlockSize);
+		}
+	}
+
+	/**
+	 * Allocates uninitialized memory for count objects of type T.
+	 *
+	 * @param count
+	 * @return The allocated memory. Stays valid until the arena is reset or rewound past it.
+	 */
+	template<typename T>
+	T * allocate(size_t count) {
+		return static_cast<T *>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	/**
+	 * @return The current position within the arena.
+	 */
+	Marker getMarker() const {
+		return Marker{currentBlock, currentOffset};
+	}
+
+	/**
+	 * Frees everything that has been allocated since the given marker was taken.
+	 *
+	 * @param marker
+	 */
+	void rewind(Marker marker) {
+		currentBlock = marker.block;
+		currentOffset = marker.offset;
+	}
+
+	/**
+	 * Frees everything that has been allocated from this arena.
+	 * If more than one block of memory was needed, they are replaced by one that
+	 * is large enough for all of them, so steady-state resets only move a pointer.
+	 */
+	void reset() {
+		if (blocks.size() > 1) {
+			size_t totalSize = 0;
+			for (const Block& block: blocks) {
+				totalSize += block.size;
+			}
+			blocks.clear();
+			addBlock(totalSize);
+		}
+
+		currentBlock = 0;
+		currentOffset = 0;
+	}
+};
+
+/**
+ * A standard allocator that allocates from an Arena, or from the heap if it doesn't
+ * have one. Deallocating memory of an arena does nothing; it is freed when the arena is reset.
+ *
+ * @tparam T The type of objects to allocate.
+ */
+template<typename T>
+class ArenaAllocator {
+private:
+	template<typename U>
+	friend class ArenaAllocator;
+
+	Arena *arena;
+
+public:
+	using value_type = T;
+
+	/**
+	 * @param arena The arena to allocate from, or nullptr to allocate from the heap.
+	 */
+	ArenaAllocator(Arena *arena = nullptr) noexcept:
+		arena(arena)
+	{
+		//Nothing else to do
+	}
+
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) noexcept:
+		arena(other.arena)
+	{
+		//Nothing else to do
+	}
+
+	T * allocate(size_t count) {
+		if (arena) {
+			return arena->allocate<T>(count);
+		}
+		return static_cast<T *>(::operator new(count * sizeof(T)));
+	}
+
+	void deallocate(T *pointer, size_t) noexcept {
+		if (!arena) {
+			::operator delete(pointer);
+		}
+	}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const noexcept {
+		return arena == other.arena;
+	}
+
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const noexcept {
+		return arena != other.arena;
+	}
+};
+
+}
+
+
+#endif /* ARENA_HPP_ */
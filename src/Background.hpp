@@ -0,0 +1,44 @@
+/*
+ * Background.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef BACKGROUND_HPP_
+#define BACKGROUND_HPP_
+
+#include <cstdint>
+
+using namespace std;
+
+namespace mmo2020 {
+
+
+/**
+ * What the renderer puts behind all sprites, see SpriteRenderer::setBackgroundColor,
+ * SpriteRenderer::setBackgroundImage and SpriteRenderer::setBackgroundUntouched.
+ */
+enum class BackgroundMode: uint8_t {
+	/**
+	 * A solid color, black by default.
+	 */
+	Color,
+
+	/**
+	 * An image that is already packed in the framebuffer's pixel format. Pixels without
+	 * any sprites are copied from it as they are.
+	 */
+	Image,
+
+	/**
+	 * Whatever the framebuffer already contains. Pixels without any sprites aren't written at all.
+	 */
+	Untouched
+};
+
+
+}
+
+
+#endif /* BACKGROUND_HPP_ */
@@ -0,0 +1,103 @@
+/*
+ * BackgroundWorker.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef BACKGROUNDWORKER_HPP_
+#define BACKGROUNDWORKER_HPP_
+
+#include <deque>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+namespace ttlhacker {
+
+
+/**
+ * A thread that runs jobs one after another, in the order in which they were submitted.
+ * Unlike a new thread per job, the same thread is kept alive, so starting a job
+ * is cheap and thread-local state survives from one job to the next.
+ *
+ * The destructor waits until all submitted jobs are done.
+ */
+class BackgroundWorker {
+private:
+	mutex jobsMutex;
+	condition_variable jobsChanged;
+	deque<packaged_task<void()>> jobs;
+	bool isStopping = false;
+
+	/**
+	 * Declared last, so everything above is initialized before the thread starts.
+	 */
+	thread workerThread;
+
+	void run() {
+		while (true) {
+			packaged_task<void()> job;
+			{
+				unique_lock<mutex> lock(jobsMutex);
+				jobsChanged.wait(lock, [&]() {
+					return isStopping || !jobs.empty();
+				});
+				if (jobs.empty()) {
+					return;
+				}
+				job = move(jobs.front());
+				jobs.pop_front();
+			}
+
+			//Exceptions end up in the job's future.
+			job();
+		}
+	}
+
+public:
+	BackgroundWorker():
+		workerThread([this]() { run(); })
+	{
+		//Nothing else to initialize
+	}
+
+	BackgroundWorker(const BackgroundWorker&) = delete;
+	BackgroundWorker& operator=(const BackgroundWorker&) = delete;
+
+	~BackgroundWorker() {
+		{
+			lock_guard<mutex> lock(jobsMutex);
+			isStopping = true;
+		}
+		jobsChanged.notify_one();
+		workerThread.join();
+	}
+
+	/**
+	 * Queues a job to run on the worker thread.
+	 *
+	 * @param job Callable without arguments. May be move-only.
+	 * @return Becomes ready once the job is done.
+	 */
+	template<typename Job>
+	future<void> submit(Job&& job) {
+		packaged_task<void()> task(forward<Job>(job));
+		future<void> done = task.get_future();
+		{
+			lock_guard<mutex> lock(jobsMutex);
+			jobs.push_back(move(task));
+		}
+		jobsChanged.notify_one();
+		return done;
+	}
+};
+
+}
+
+
+#endif /* BACKGROUNDWORKER_HPP_ */
@@ -0,0 +1,143 @@
+/*
+ * BatchRenderer.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef BATCHRENDERER_HPP_
+#define BATCHRENDERER_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cassert>
+
+#include "SpriteRenderer.hpp"
+#include "SpriteScene.hpp"
+#include "TaskPool.hpp"
+#include "Viewport.hpp"
+
+using namespace std;
+using namespace ttlhacker;
+
+namespace mmo2020 {
+
+
+/**
+ * One frame of a batch: a part of a scene and the framebuffer to render it into.
+ */
+struct BatchJob {
+	const SpriteScene *scene;
+	Viewport viewport;
+};
+
+
+/**
+ * Renders many small, independent frames, e.g. thumbnails. A single small frame has too
+ * little work to be worth splitting between threads, so instead each thread of the task pool
+ * renders whole frames on its own, one after another, with a renderer that it keeps for all
+ * batches. The storage of those renderers is reused from frame to frame, so rendering a frame
+ * hardly allocates anything once the renderers have seen frames of similar size.
+ *
+ * @tparam Renderer The SpriteRenderer that renders each frame, see there for its template parameters.
+ */
+template<typename Renderer = SpriteRenderer<>>
+class BatchRenderer {
+private:
+	/**
+	 * The renderer of one thread, which renders on that thread alone, and the viewport of its current job.
+	 */
+	struct Worker {
+		unique_ptr<Renderer> renderer;
+		vector<Viewport> viewports;
+	};
+
+	function<unique_ptr<Renderer>()> makeRenderer;
+	shared_ptr<TaskPool> taskPool = TaskPool::getDefault();
+	vector<Worker> workers;
+
+	/**
+	 * Makes sure there is a worker for every thread of the task pool.
+	 */
+	void prepareWorkers() {
+		const size_t numThreads = taskPool->getNumThreads();
+		while (workers.size() < numThreads) {
+			Worker worker{makeRenderer(), vector<Viewport>(1)};
+			worker.renderer->setTaskPool(make_shared<TaskPool>(1));
+			workers.push_back(move(worker));
+		}
+	}
+
+public:
+	/**
+	 * @param pixelFormatArgs The arguments for the pixel format of the renderers, as for the constructors
+	 *                        of SpriteRenderer after the size, e.g. nothing or a PixelFormat.
+	 */
+	template<typename... PixelFormatArgs>
+	explicit BatchRenderer(PixelFormatArgs... pixelFormatArgs):
+		makeRenderer([=]() {
+			//The size doesn't matter, every frame is rendered as a viewport of its own size.
+			return make_unique<Renderer>(0, 0, pixelFormatArgs...);
+		})
+	{
+		//Nothing else to initialize
+	}
+
+	BatchRenderer(const BatchRenderer&) = delete;
+	BatchRenderer& operator=(const BatchRenderer&) = delete;
+
+	/**
+	 * Makes this renderer split its batches between the given threads instead of TaskPool::getDefault().
+	 * Must not be called while a batch is being rendered.
+	 *
+	 * @param taskPool
+	 */
+	void setTaskPool(shared_ptr<TaskPool> taskPool) {
+		assert(taskPool);
+		this->taskPool = move(taskPool);
+	}
+
+	/**
+	 * Calls callback(renderer) for the renderer of each thread that has been created so far, e.g.
+	 * to read their statistics. Must not be called while a batch is being rendered.
+	 *
+	 * @param callback
+	 */
+	template<typename Callback>
+	void forEachRenderer(Callback callback) {
+		for (Worker& worker: workers) {
+			callback(*worker.renderer);
+		}
+	}
+
+	/**
+	 * Renders all jobs and returns once they are done. The jobs are split between the threads
+	 * by the size of their framebuffers, each job is rendered by one thread. Several jobs may
+	 * render the same scene, but their framebuffers must not overlap.
+	 *
+	 * None of the scenes may be modified while rendering.
+	 *
+	 * @param jobs
+	 */
+	void render(const vector<BatchJob>& jobs) {
+		prepareWorkers();
+
+		taskPool->parallelFor(0, jobs.size(), [&](int job, int threadIndex) {
+			Worker& worker = workers[threadIndex];
+			worker.viewports[0] = jobs[job].viewport;
+			worker.renderer->render(*jobs[job].scene, worker.viewports);
+		}, [&](int job) {
+			const IntRectangle<int32_t>& area = jobs[job].viewport.area;
+			return (size_t)area.width * area.height + 1;
+		});
+	}
+};
+
+
+}
+
+
+#endif /* BATCHRENDERER_HPP_ */
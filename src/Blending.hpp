@@ -0,0 +1,478 @@
+/*
+ * Blending.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef BLENDING_HPP_
+#define BLENDING_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "SpritePixel.hpp"
+
+using namespace std;
+
+namespace mmo2020 {
+
+
+/**
+ * How the pixels of a sprite are combined with whatever lies below them.
+ * In all modes, the pixels' alpha and the sprite's opacity say how strongly the sprite shows.
+ */
+enum class BlendMode: uint8_t {
+	/**
+	 * The sprite is painted over what lies below.
+	 */
+	Normal,
+
+	/**
+	 * The sprite's colors are added to what lies below. Doesn't hide anything.
+	 */
+	Additive,
+
+	/**
+	 * What lies below is multiplied by the sprite's colors. Only darkens.
+	 */
+	Multiply
+};
+
+/*
+ * Sprites are composited front to back: the renderer walks the sprites from the topmost
+ * one down and composites each of them below the pixels accumulated so far. For each
+ * pixel, it keeps
+ *  - the accumulated color, premultiplied, as a SpritePixel (the alpha byte is unused), and
+ *  - the transmittance, how much of each color channel of the sprites further below
+ *    still shines through, as a packed 0x00BBGGRR uint32_t. 0x00FFFFFF for nothing yet.
+ * As soon as the transmittance of a pixel is 0, nothing below can change it anymore.
+ * The accumulated color is the final color on a black background.
+ *
+ * The vectorized kernels compute exactly the same values as the scalar code.
+ *
+ * Along with the transmittance, the kernels write a bitmask of the pixels that are still
+ * unresolved (transmittance not 0), one bit per pixel with pixel i in bit i % 64 of word i / 64.
+ * The vectorized kernels get those bits from a compare of 8 or 4 pixels at once, so the
+ * renderer can find the pixels that still need a sprite further below without looking
+ * at the transmittance of each of them.
+ */
+
+/**
+ * The transmittance of a pixel that nothing has been composited into yet.
+ */
+constexpr uint32_t fullTransmittance = 0x00FFFFFF;
+
+/**
+ * @param count
+ * @return The number of 64 bit words of a bitmask of count pixels.
+ */
+constexpr int getNumMaskWords(int count) {
+	return (count + 63) / 64;
+}
+
+/**
+ * @param mask
+ * @param begin
+ * @param end
+ * @return The index of the first set bit from begin up to end, or end if there is none.
+ */
+inline int findFirstSetBit(const uint64_t *mask, int begin, int end) {
+	int i = begin;
+	while (i < end) {
+		const uint64_t bits = mask[i / 64] >> (i % 64);
+		if (bits != 0) {
+			return min(end, i + __builtin_ctzll(bits));
+		}
+		i = (i / 64 + 1) * 64;
+	}
+	return end;
+}
+
+/**
+ * @param mask
+ * @param begin
+ * @param end
+ * @return The index of the last set bit from begin up to end, or begin - 1 if there is none.
+ */
+inline int findLastSetBit(const uint64_t *mask, int begin, int end) {
+	int i = end - 1;
+	while (i >= begin) {
+		const uint64_t bits = mask[i / 64] << (63 - i % 64);
+		if (bits != 0) {
+			return max(begin - 1, i - __builtin_clzll(bits));
+		}
+		i = (i / 64) * 64 - 1;
+	}
+	return begin - 1;
+}
+
+/**
+ * Calls callback(i) for every set bit i from begin up to end, in ascending order.
+ *
+ * @param mask
+ * @param begin
+ * @param end
+ * @param callback
+ */
+template<typename Callback>
+inline void forEachSetBit(const uint64_t *mask, int begin, int end, Callback callback) {
+	for (int word = begin / 64; word * 64 < end; word++) {
+		uint64_t bits = mask[word];
+		if (word * 64 < begin) {
+			bits &= ~(uint64_t)0 << (begin % 64);
+		}
+		if ((word + 1) * 64 > end) {
+			bits &= ~(~(uint64_t)0 << (end % 64));
+		}
+		while (bits != 0) {
+			callback(word * 64 + __builtin_ctzll(bits));
+			bits &= bits - 1;
+		}
+	}
+}
+
+/**
+ * @param x At most 255 * 255.
+ * @return x / 255, rounded to the nearest integer.
+ */
+constexpr uint32_t divideBy255(uint32_t x) {
+	return (x + 128 + ((x + 128) >> 8)) >> 8;
+}
+
+/**
+ * Composites one pixel below an accumulated pixel.
+ *
+ * @param src           The pixel of the sprite.
+ * @param opacity       The opacity of the sprite.
+ * @param accumulated
+ * @param transmittance
+ */
+template<BlendMode mode>
+inline void compositePixelBelow(SpritePixel src, uint8_t opacity, SpritePixel& accumulated, uint32_t& transmittance) {
+	const uint32_t alpha = divideBy255(src.a * opacity);
+	uint8_t srcChannels[4], accChannels[4];
+	memcpy(srcChannels, &src, 4);
+	memcpy(accChannels, &accumulated, 4);
+
+	uint32_t newTransmittance = 0;
+	for (int channel = 0; channel < 4; channel++) {
+		const uint32_t t = (transmittance >> (channel * 8)) & 0xFF;
+		const uint32_t c = srcChannels[channel];
+		uint32_t newT = t;
+
+		if (mode == BlendMode::Multiply) {
+			newT = divideBy255(t * (255 - alpha + divideBy255(alpha * c)));
+		} else {
+			const uint32_t weight = divideBy255(t * alpha);
+			accChannels[channel] = min<uint32_t>(255, accChannels[channel] + divideBy255(weight * c));
+			if (mode == BlendMode::Normal) {
+				newT = divideBy255(t * (255 - alpha));
+			}
+		}
+
+		newTransmittance |= newT << (channel * 8);
+	}
+
+	memcpy(&accumulated, accChannels, 4);
+	transmittance = newTransmittance;
+}
+
+#if defined(__AVX2__)
+/**
+ * @param x Each 16 bit lane at most 255 * 255.
+ * @return Each 16 bit lane divided by 255, see divideBy255.
+ */
+inline __m256i divideBy255x16(__m256i x) {
+	x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+	return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+/**
+ * Composites two pixels per 128 bit lane, widened to 16 bits per channel.
+ */
+template<BlendMode mode>
+inline void compositeBelowx16(__m256i src, __m256i opacity, __m256i& accumulated, __m256i& transmittance) {
+	const __m256i srcAlpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(src, 0xFF), 0xFF);
+	const __m256i alpha = divideBy255x16(_mm256_mullo_epi16(srcAlpha, opacity));
+
+	if (mode == BlendMode::Multiply) {
+		const __m256i factor = _mm256_add_epi16(_mm256_sub_epi16(_mm256_set1_epi16(255), alpha), divideBy255x16(_mm256_mullo_epi16(alpha, src)));
+		transmittance = divideBy255x16(_mm256_mullo_epi16(transmittance, factor));
+	} else {
+		const __m256i weight = divideBy255x16(_mm256_mullo_epi16(transmittance, alpha));
+		accumulated = _mm256_add_epi16(accumulated, divideBy255x16(_mm256_mullo_epi16(weight, src)));
+		if (mode == BlendMode::Normal) {
+			transmittance = divideBy255x16(_mm256_mullo_epi16(transmittance, _mm256_sub_epi16(_mm256_set1_epi16(255), alpha)));
+		}
+	}
+}
+
+/**
+ * Sets the bits of the unresolved pixels among the 8 pixels beginning at pixel i in the given bitmask.
+ *
+ * @param transmittance The transmittance of the 8 pixels.
+ * @param i             A multiple of 8.
+ * @param unresolvedMask
+ */
+inline void storeUnresolvedBitsx8(__m256i transmittance, int i, uint64_t *unresolvedMask) {
+	const int resolved = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(transmittance, _mm256_setzero_si256())));
+	unresolvedMask[i / 64] |= (uint64_t)(~resolved & 0xFF) << (i % 64);
+}
+#endif
+
+#if defined(__SSE2__)
+/**
+ * @param x Each 16 bit lane at most 255 * 255.
+ * @return Each 16 bit lane divided by 255, see divideBy255.
+ */
+inline __m128i divideBy255x8(__m128i x) {
+	x = _mm_add_epi16(x, _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+/**
+ * Composites two pixels, widened to 16 bits per channel.
+ */
+template<BlendMode mode>
+inline void compositeBelowx8(__m128i src, __m128i opacity, __m128i& accumulated, __m128i& transmittance) {
+	const __m128i srcAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xFF), 0xFF);
+	const __m128i alpha = divideBy255x8(_mm_mullo_epi16(srcAlpha, opacity));
+
+	if (mode == BlendMode::Multiply) {
+		const __m128i factor = _mm_add_epi16(_mm_sub_epi16(_mm_set1_epi16(255), alpha), divideBy255x8(_mm_mullo_epi16(alpha, src)));
+		transmittance = divideBy255x8(_mm_mullo_epi16(transmittance, factor));
+	} else {
+		const __m128i weight = divideBy255x8(_mm_mullo_epi16(transmittance, alpha));
+		accumulated = _mm_add_epi16(accumulated, divideBy255x8(_mm_mullo_epi16(weight, src)));
+		if (mode == BlendMode::Normal) {
+			transmittance = divideBy255x8(_mm_mullo_epi16(transmittance, _mm_sub_epi16(_mm_set1_epi16(255), alpha)));
+		}
+	}
+}
+
+/**
+ * Sets the bits of the unresolved pixels among the 4 pixels beginning at pixel i in the given bitmask.
+ *
+ * @param transmittance The transmittance of the 4 pixels.
+ * @param i             A multiple of 4.
+ * @param unresolvedMask
+ */
+inline void storeUnresolvedBitsx4(__m128i transmittance, int i, uint64_t *unresolvedMask) {
+	const int resolved = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(transmittance, _mm_setzero_si128())));
+	unresolvedMask[i / 64] |= (uint64_t)(~resolved & 0xF) << (i % 64);
+}
+#endif
+
+/**
+ * Composites a span of sprite pixels below the pixels accumulated so far.
+ *
+ * @param src           The pixels of the sprite.
+ * @param count
+ * @param opacity       The opacity of the sprite.
+ * @param accumulated   The accumulated colors, see above.
+ * @param transmittance The transmittance of the accumulated pixels, see above.
+ * @param unresolvedMask Receives the pixels that are still unresolved afterwards, see above.
+ */
+template<BlendMode mode>
+inline void compositeSpanBelow(const SpritePixel *src, int count, uint8_t opacity, SpritePixel *accumulated, uint32_t *transmittance, uint64_t *unresolvedMask) {
+	fill_n(unresolvedMask, getNumMaskWords(count), 0);
+	int i = 0;
+
+#if defined(__AVX2__)
+	const __m256i zero8 = _mm256_setzero_si256();
+	const __m256i opacity8 = _mm256_set1_epi16(opacity);
+	for (; i + 8 <= count; i += 8) {
+		const __m256i t = _mm256_loadu_si256((const __m256i *)(transmittance + i));
+		if (_mm256_testz_si256(t, t)) {
+			//Already resolved, nothing below can be seen.
+			continue;
+		}
+
+		const __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+		const __m256i c = _mm256_loadu_si256((const __m256i *)(accumulated + i));
+
+		//The unpacks and packs work within 128 bit lanes, so the pixels end up where they were.
+		__m256i sLow = _mm256_unpacklo_epi8(s, zero8), sHigh = _mm256_unpackhi_epi8(s, zero8);
+		__m256i cLow = _mm256_unpacklo_epi8(c, zero8), cHigh = _mm256_unpackhi_epi8(c, zero8);
+		__m256i tLow = _mm256_unpacklo_epi8(t, zero8), tHigh = _mm256_unpackhi_epi8(t, zero8);
+		compositeBelowx16<mode>(sLow, opacity8, cLow, tLow);
+		compositeBelowx16<mode>(sHigh, opacity8, cHigh, tHigh);
+
+		const __m256i newT = _mm256_packus_epi16(tLow, tHigh);
+		_mm256_storeu_si256((__m256i *)(accumulated + i), _mm256_packus_epi16(cLow, cHigh));
+		_mm256_storeu_si256((__m256i *)(transmittance + i), newT);
+		storeUnresolvedBitsx8(newT, i, unresolvedMask);
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i opacity4 = _mm_set1_epi16(opacity);
+	for (; i + 4 <= count; i += 4) {
+		const __m128i t = _mm_loadu_si128((const __m128i *)(transmittance + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(t, zero)) == 0xFFFF) {
+			continue;
+		}
+
+		const __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+		const __m128i c = _mm_loadu_si128((const __m128i *)(accumulated + i));
+
+		__m128i sLow = _mm_unpacklo_epi8(s, zero), sHigh = _mm_unpackhi_epi8(s, zero);
+		__m128i cLow = _mm_unpacklo_epi8(c, zero), cHigh = _mm_unpackhi_epi8(c, zero);
+		__m128i tLow = _mm_unpacklo_epi8(t, zero), tHigh = _mm_unpackhi_epi8(t, zero);
+		compositeBelowx8<mode>(sLow, opacity4, cLow, tLow);
+		compositeBelowx8<mode>(sHigh, opacity4, cHigh, tHigh);
+
+		const __m128i newT = _mm_packus_epi16(tLow, tHigh);
+		_mm_storeu_si128((__m128i *)(accumulated + i), _mm_packus_epi16(cLow, cHigh));
+		_mm_storeu_si128((__m128i *)(transmittance + i), newT);
+		storeUnresolvedBitsx4(newT, i, unresolvedMask);
+	}
+#endif
+
+	for (; i < count; i++) {
+		compositePixelBelow<mode>(src[i], opacity, accumulated[i], transmittance[i]);
+		unresolvedMask[i / 64] |= (uint64_t)(transmittance[i] != 0) << (i % 64);
+	}
+}
+
+/**
+ * Composites a span of pixels of the topmost sprite below nothing and turns them into
+ * accumulated pixels in place. Cheap where the pixels are opaque and drawn normally.
+ *
+ * @param pixels        The pixels of the sprite. Receives the accumulated colors.
+ * @param count
+ * @param opacity       The opacity of the sprite.
+ * @param transmittance Receives the transmittance of the accumulated pixels.
+ * @param unresolvedMask Receives the pixels that are still unresolved afterwards, see above.
+ */
+template<BlendMode mode>
+inline void compositeSpanBelowNothing(SpritePixel *pixels, int count, uint8_t opacity, uint32_t *transmittance, uint64_t *unresolvedMask) {
+	//Opaque pixels that are drawn normally stay as they are and hide everything below.
+	const bool isOpaqueIfAlphaIs255 = (mode == BlendMode::Normal) && (opacity == 0xFF);
+	fill_n(unresolvedMask, getNumMaskWords(count), 0);
+	int i = 0;
+
+#if defined(__AVX2__)
+	const __m256i zero8 = _mm256_setzero_si256();
+	const __m256i alphaMask8 = _mm256_set1_epi32(0xFF000000);
+	const __m256i opacity8 = _mm256_set1_epi16(opacity);
+	const __m256i fullTransmittance8 = _mm256_unpacklo_epi8(_mm256_set1_epi32(fullTransmittance), zero8);
+	for (; i + 8 <= count; i += 8) {
+		const __m256i s = _mm256_loadu_si256((const __m256i *)(pixels + i));
+		if (isOpaqueIfAlphaIs255 && _mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(s, alphaMask8), alphaMask8)) == -1) {
+			_mm256_storeu_si256((__m256i *)(transmittance + i), zero8);
+			continue;
+		}
+
+		__m256i cLow = zero8, cHigh = zero8;
+		__m256i tLow = fullTransmittance8, tHigh = fullTransmittance8;
+		compositeBelowx16<mode>(_mm256_unpacklo_epi8(s, zero8), opacity8, cLow, tLow);
+		compositeBelowx16<mode>(_mm256_unpackhi_epi8(s, zero8), opacity8, cHigh, tHigh);
+
+		const __m256i newT = _mm256_packus_epi16(tLow, tHigh);
+		_mm256_storeu_si256((__m256i *)(pixels + i), _mm256_packus_epi16(cLow, cHigh));
+		_mm256_storeu_si256((__m256i *)(transmittance + i), newT);
+		storeUnresolvedBitsx8(newT, i, unresolvedMask);
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+	const __m128i opacity4 = _mm_set1_epi16(opacity);
+	const __m128i fullTransmittance4 = _mm_unpacklo_epi8(_mm_set1_epi32(fullTransmittance), zero);
+	for (; i + 4 <= count; i += 4) {
+		const __m128i s = _mm_loadu_si128((const __m128i *)(pixels + i));
+		if (isOpaqueIfAlphaIs255 && _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alphaMask), alphaMask)) == 0xFFFF) {
+			_mm_storeu_si128((__m128i *)(transmittance + i), zero);
+			continue;
+		}
+
+		__m128i cLow = zero, cHigh = zero;
+		__m128i tLow = fullTransmittance4, tHigh = fullTransmittance4;
+		compositeBelowx8<mode>(_mm_unpacklo_epi8(s, zero), opacity4, cLow, tLow);
+		compositeBelowx8<mode>(_mm_unpackhi_epi8(s, zero), opacity4, cHigh, tHigh);
+
+		const __m128i newT = _mm_packus_epi16(tLow, tHigh);
+		_mm_storeu_si128((__m128i *)(pixels + i), _mm_packus_epi16(cLow, cHigh));
+		_mm_storeu_si128((__m128i *)(transmittance + i), newT);
+		storeUnresolvedBitsx4(newT, i, unresolvedMask);
+	}
+#endif
+
+	for (; i < count; i++) {
+		if (isOpaqueIfAlphaIs255 && pixels[i].isOpaque()) {
+			transmittance[i] = 0;
+			continue;
+		}
+
+		const SpritePixel src = pixels[i];
+		pixels[i] = SpritePixel();
+		transmittance[i] = fullTransmittance;
+		compositePixelBelow<mode>(src, opacity, pixels[i], transmittance[i]);
+		unresolvedMask[i / 64] |= (uint64_t)(transmittance[i] != 0) << (i % 64);
+	}
+}
+
+/**
+ * Composites a span of sprite pixels below the pixels accumulated so far.
+ *
+ * @param src           The pixels of the sprite.
+ * @param count
+ * @param opacity       The opacity of the sprite.
+ * @param mode
+ * @param accumulated   The accumulated colors, see above.
+ * @param transmittance The transmittance of the accumulated pixels, see above.
+ * @param unresolvedMask Receives the pixels that are still unresolved afterwards, see above.
+ */
+inline void compositeSpanBelow(const SpritePixel *src, int count, uint8_t opacity, BlendMode mode, SpritePixel *accumulated, uint32_t *transmittance, uint64_t *unresolvedMask) {
+	switch (mode) {
+		case BlendMode::Normal:
+			compositeSpanBelow<BlendMode::Normal>(src, count, opacity, accumulated, transmittance, unresolvedMask);
+			break;
+		case BlendMode::Additive:
+			compositeSpanBelow<BlendMode::Additive>(src, count, opacity, accumulated, transmittance, unresolvedMask);
+			break;
+		case BlendMode::Multiply:
+			compositeSpanBelow<BlendMode::Multiply>(src, count, opacity, accumulated, transmittance, unresolvedMask);
+			break;
+	}
+}
+
+
+/**
+ * Composites a span of pixels of the topmost sprite below nothing, see above.
+ *
+ * @param pixels        The pixels of the sprite. Receives the accumulated colors.
+ * @param count
+ * @param opacity       The opacity of the sprite.
+ * @param mode
+ * @param transmittance Receives the transmittance of the accumulated pixels.
+ * @param unresolvedMask Receives the pixels that are still unresolved afterwards, see above.
+ */
+inline void compositeSpanBelowNothing(SpritePixel *pixels, int count, uint8_t opacity, BlendMode mode, uint32_t *transmittance, uint64_t *unresolvedMask) {
+	switch (mode) {
+		case BlendMode::Normal:
+			compositeSpanBelowNothing<BlendMode::Normal>(pixels, count, opacity, transmittance, unresolvedMask);
+			break;
+		case BlendMode::Additive:
+			compositeSpanBelowNothing<BlendMode::Additive>(pixels, count, opacity, transmittance, unresolvedMask);
+			break;
+		case BlendMode::Multiply:
+			compositeSpanBelowNothing<BlendMode::Multiply>(pixels, count, opacity, transmittance, unresolvedMask);
+			break;
+	}
+}
+
+
+}
+
+
+#endif /* BLENDING_HPP_ */
@@ -0,0 +1,338 @@
+/*
+ * FrameStats.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef FRAMESTATS_HPP_
+#define FRAMESTATS_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+using namespace std;
+
+namespace mmo2020 {
+
+
+/**
+ * The phases of rendering a frame.
+ */
+enum class FramePhase: uint8_t {
+	/**
+	 * Finding the visible sprites of a list of sprites.
+	 */
+	Cull,
+
+	/**
+	 * Sorting the visible sprites.
+	 */
+	Sort,
+
+	/**
+	 * Sorting the sprites into blocks of lines or tiles.
+	 */
+	Bin,
+
+	/**
+	 * Bringing the RasterLines up to date with a scene.
+	 */
+	SyncScene,
+
+	/**
+	 * Distributing the sprites to the lines and rasterizing them into the framebuffer.
+	 */
+	Render,
+
+	/**
+	 * Removing the sprites of a previously bound scene from the RasterLines.
+	 */
+	Clear
+};
+
+constexpr size_t numFramePhases = 6;
+
+/**
+ * @param phase
+ * @return The name of the phase, e.g. for trace events.
+ */
+inline const char * getFramePhaseName(FramePhase phase) {
+	static const char * const names[numFramePhases] = {"Cull", "Sort", "Bin", "SyncScene", "Render", "Clear"};
+	return names[(size_t)phase];
+}
+
+
+/**
+ * The counters of one thread for one frame. Only ever written by that thread, and
+ * aligned to a cache line so that the threads don't write to the same one.
+ */
+struct alignas(64) ThreadFrameStats {
+	/**
+	 * The render tasks (blocks, lines or tiles) that the thread ran, and the time it spent in them.
+	 */
+	uint64_t numTasks = 0;
+	uint64_t taskNanos = 0;
+
+	/**
+	 * The rendered lines (or rows of tiles), and how many of them had more sprites than
+	 * fit into their inline storage, so their sprite lists spilled to an arena or the heap.
+	 */
+	uint64_t numLines = 0;
+	uint64_t numSpilledLines = 0;
+
+	/**
+	 * The rendered runs of pixels, and the pixels in them.
+	 */
+	uint64_t numRuns = 0;
+	uint64_t numPixels = 0;
+
+	/**
+	 * The number of sprites that had to be sampled for each run: sum and maximum.
+	 * The average is the average depth of the sprite stack that had to be looked at.
+	 */
+	uint64_t numSampledSprites = 0;
+	uint64_t maxSampledSprites = 0;
+
+	/**
+	 * Pixels that had to be fetched one by one because their sprite's source can't provide spans.
+	 */
+	uint64_t numSinglePixelFetches = 0;
+
+	void countTask(uint64_t nanos) {
+		numTasks++;
+		taskNanos += nanos;
+	}
+
+	void countLine(bool isSpilled) {
+		numLines++;
+		numSpilledLines += isSpilled;
+	}
+
+	void countRun(int nPixels, int nSampledSprites) {
+		numRuns++;
+		numPixels += nPixels;
+		numSampledSprites += nSampledSprites;
+		maxSampledSprites = max<uint64_t>(maxSampledSprites, nSampledSprites);
+	}
+
+	void countSinglePixelFetches(int nPixels) {
+		numSinglePixelFetches += nPixels;
+	}
+
+	/**
+	 * Adds the counters of another thread to these.
+	 *
+	 * @param other
+	 */
+	void add(const ThreadFrameStats& other) {
+		numTasks += other.numTasks;
+		taskNanos += other.taskNanos;
+		numLines += other.numLines;
+		numSpilledLines += other.numSpilledLines;
+		numRuns += other.numRuns;
+		numPixels += other.numPixels;
+		numSampledSprites += other.numSampledSprites;
+		maxSampledSprites = max(maxSampledSprites, other.maxSampledSprites);
+		numSinglePixelFetches += other.numSinglePixelFetches;
+	}
+};
+
+
+/**
+ * The statistics of one frame.
+ */
+struct FrameStats {
+	/**
+	 * The wall clock time of each phase on the thread that called the render method,
+	 * indexed by FramePhase. A phase that ran several times is summed up. SyncScene includes
+	 * the Clear and Bin phases when a scene has to be redistributed from scratch.
+	 */
+	uint64_t phaseNanos[numFramePhases] = {};
+
+	/**
+	 * The counters of each thread of the task pool.
+	 */
+	vector<ThreadFrameStats> threads;
+
+	uint64_t getPhaseNanos(FramePhase phase) const {
+		return phaseNanos[(size_t)phase];
+	}
+
+	/**
+	 * @return The counters of all threads added up.
+	 */
+	ThreadFrameStats getTotals() const {
+		ThreadFrameStats totals;
+		for (const ThreadFrameStats& thread: threads) {
+			totals.add(thread);
+		}
+		return totals;
+	}
+
+	/**
+	 * @return The average number of sprites that had to be sampled per run of pixels.
+	 */
+	double getAverageSampledSprites() const {
+		const ThreadFrameStats totals = getTotals();
+		return totals.numRuns ? (double)totals.numSampledSprites / totals.numRuns : 0;
+	}
+
+	/**
+	 * Resets all counters and timings.
+	 *
+	 * @param numThreads The number of threads of the task pool.
+	 */
+	void clear(int numThreads) {
+		fill(phaseNanos, phaseNanos + numFramePhases, 0);
+		threads.assign(numThreads, ThreadFrameStats());
+	}
+};
+
+
+/*
+ * Stats policies for SpriteRenderer. They decide what is recorded while rendering a frame.
+ * All of them provide the following:
+ *
+ * Counters
+ *     The type of the counters of one thread, with the counting methods of ThreadFrameStats.
+ *
+ * void beginFrame(int numThreads)
+ *     Called at the start of each render method, with the number of threads of the task pool.
+ *
+ * void beginPhase(FramePhase phase), void endPhase(FramePhase phase)
+ *     Called by the thread that called the render method around each phase.
+ *
+ * void beginTask(FramePhase phase, int threadIndex), void endTask(FramePhase phase, int threadIndex)
+ *     Called by each thread around each of the render tasks it runs.
+ *
+ * Counters& getCounters(int threadIndex)
+ *     The counters of the given thread. Only called by that thread during a frame.
+ */
+
+
+/**
+ * Records nothing. All of its methods are empty, so the compiler removes the calls to them entirely.
+ */
+class NoFrameStats {
+public:
+	struct Counters {
+		void countTask(uint64_t) {}
+		void countLine(bool) {}
+		void countRun(int, int) {}
+		void countSinglePixelFetches(int) {}
+	};
+
+private:
+	Counters counters;
+
+public:
+	void beginFrame(int) {}
+	void beginPhase(FramePhase) {}
+	void endPhase(FramePhase) {}
+	void beginTask(FramePhase, int) {}
+	void endTask(FramePhase, int) {}
+
+	Counters& getCounters(int) {
+		return counters;
+	}
+};
+
+
+/**
+ * Records the timings of all phases and the counters of all threads into a FrameStats,
+ * which can be read after each frame. Can also pass the beginning and end of each phase
+ * and task on to a trace hook, e.g. to emit Chrome trace events or profiler zones.
+ */
+class CollectFrameStats {
+public:
+	using Counters = ThreadFrameStats;
+	using Clock = chrono::steady_clock;
+
+	/**
+	 * Called at the beginning (isBegin true) and end of each phase and each render task, on the
+	 * thread that runs it. threadIndex is 0 for phases, whose thread is the one that called the
+	 * render method, and the index within the task pool for tasks. It must be safe to call
+	 * from several threads at once.
+	 */
+	using TraceHook = function<void(FramePhase phase, int threadIndex, bool isBegin)>;
+
+private:
+	/**
+	 * The start of the current task of a thread, on its own cache line.
+	 */
+	struct alignas(64) TaskClock {
+		Clock::time_point start;
+	};
+
+	FrameStats stats;
+	Clock::time_point phaseStarts[numFramePhases];
+	vector<TaskClock> taskStarts;
+	TraceHook traceHook;
+
+	static uint64_t getNanosSince(Clock::time_point start) {
+		return chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+	}
+
+public:
+	void beginFrame(int numThreads) {
+		stats.clear(numThreads);
+		taskStarts.resize(numThreads);
+	}
+
+	void beginPhase(FramePhase phase) {
+		if (traceHook) {
+			traceHook(phase, 0, true);
+		}
+		phaseStarts[(size_t)phase] = Clock::now();
+	}
+
+	void endPhase(FramePhase phase) {
+		stats.phaseNanos[(size_t)phase] += getNanosSince(phaseStarts[(size_t)phase]);
+		if (traceHook) {
+			traceHook(phase, 0, false);
+		}
+	}
+
+	void beginTask(FramePhase phase, int threadIndex) {
+		if (traceHook) {
+			traceHook(phase, threadIndex, true);
+		}
+		taskStarts[threadIndex].start = Clock::now();
+	}
+
+	void endTask(FramePhase phase, int threadIndex) {
+		stats.threads[threadIndex].countTask(getNanosSince(taskStarts[threadIndex].start));
+		if (traceHook) {
+			traceHook(phase, threadIndex, false);
+		}
+	}
+
+	Counters& getCounters(int threadIndex) {
+		return stats.threads[threadIndex];
+	}
+
+	/**
+	 * @return The statistics of the last frame. Must not be read while rendering.
+	 */
+	const FrameStats& getLastFrame() const {
+		return stats;
+	}
+
+	/**
+	 * @param traceHook The new trace hook, or an empty function to disable tracing.
+	 */
+	void setTraceHook(TraceHook traceHook) {
+		this->traceHook = move(traceHook);
+	}
+};
+
+
+}
+
+
+#endif /* FRAMESTATS_HPP_ */
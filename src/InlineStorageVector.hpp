@@ -12,6 +12,8 @@
 #include <vector>
 #include <algorithm>
 #include <variant>
+#include <utility>
+#include <cassert>
 
 using namespace std;
 
@@ -25,12 +27,15 @@ namespace ttlhacker {
  *
  * @tparam T A default-constructible type to store in this InlineStorageVector.
  * @tparam numInlineElements The number of elements to store directly within the InlineStorageVector.
+ * @tparam Allocator         The allocator for the vector that the elements are moved to.
+ *                           Stateless allocators don't make the InlineStorageVector any larger.
  */
 template<
 	typename T,
 	size_t numInlineElements = max(
 			(ptrdiff_t)1,
-			((ptrdiff_t)sizeof(vector<T>) - (ptrdiff_t)sizeof(size_t)) / max((ptrdiff_t)1, (ptrdiff_t)sizeof(T)))>
+			((ptrdiff_t)sizeof(vector<T>) - (ptrdiff_t)sizeof(size_t)) / max((ptrdiff_t)1, (ptrdiff_t)sizeof(T))),
+	typename Allocator = allocator<T>>
 class InlineStorageVector {
 private:
 
@@ -39,101 +44,307 @@ private:
 		T elems[numInlineElements];
 	};
 
-	variant<InlineStorage, vector<T>> storage;
+	using HeapStorage = vector<T, Allocator>;
+
+	/**
+	 * Derives from the allocator so that stateless allocators don't take up any space.
+	 */
+	struct Storage: Allocator {
+		variant<InlineStorage, HeapStorage> elems;
+
+		Storage(const Allocator& allocator):
+			Allocator(allocator)
+		{
+			//Nothing else to initialize
+		}
+	};
+
+	Storage storage;
+
+	/**
+	 * Makes room for at least one more element, moving all elements to a vector if necessary.
+	 *
+	 * @return The inline storage if the next element fits into it, nullptr if the elements are in a vector.
+	 */
+	InlineStorage * prepareInsertion() {
+		InlineStorage * const inlineStorage = get_if<InlineStorage>(&storage.elems);
+		if (!inlineStorage) {
+			return nullptr;
+		}
+
+		//If there is enough space left, the element can go into the inline storage.
+		if (inlineStorage->nElems < numInlineElements) {
+			return inlineStorage;
+		}
+
+		//There's not enough space left, move all elements into a vector
+		//and store that instead.
+		moveToHeap(inlineStorage->nElems + 1);
+		return nullptr;
+	}
+
+	/**
+	 * Moves all elements from the inline storage into a vector.
+	 *
+	 * @param capacity The capacity of the new vector.
+	 */
+	void moveToHeap(size_t capacity) {
+		InlineStorage& inlineStorage = get<InlineStorage>(storage.elems);
+
+		HeapStorage vec(get_allocator());
+		vec.reserve(capacity);
+		for (size_t i = 0; i < inlineStorage.nElems; i++) {
+			vec.push_back(move(inlineStorage.elems[i]));
+		}
+		storage.elems = move(vec);
+	}
 
 public:
+	using value_type = T;
+	using allocator_type = Allocator;
+	using iterator = T *;
+	using const_iterator = const T *;
+
+	InlineStorageVector():
+		storage(Allocator())
+	{
+		//Nothing else to initialize
+	}
+
+	/**
+	 * @param allocator The allocator to use once the elements don't fit into the inline storage anymore.
+	 */
+	explicit InlineStorageVector(const Allocator& allocator):
+		storage(allocator)
+	{
+		//Nothing else to initialize
+	}
+
+	/**
+	 * @return The allocator used for the vector that the elements are moved to.
+	 */
+	Allocator get_allocator() const {
+		return storage;
+	}
+
 	/**
 	 * Puts a copy of the given element into this list.
 	 *
 	 * @param elem
 	 */
-	void put(T& elem) {
-		if (InlineStorage * const inlineStorage = get_if<InlineStorage>(&storage)) {
-			//Storage is currently inline. Add to the array if possible
-			//or move all elements to a vector.
-			size_t &nElems = inlineStorage->nElems;
+	void put(const T& elem) {
+		push_back(elem);
+	}
 
-			//If there is enough space left, just put the element into the inline storage.
-			if (nElems < numInlineElements) {
-				inlineStorage->elems[nElems] = elem;
-				nElems++;
-				return;
-			}
+	/**
+	 * Appends a copy of the given element.
+	 *
+	 * @param elem
+	 */
+	void push_back(const T& elem) {
+		emplace_back(elem);
+	}
 
-			//There's not enough space left, move all elements into a vector
-			//and store that instead.
+	/**
+	 * Appends the given element by moving it.
+	 *
+	 * @param elem
+	 */
+	void push_back(T&& elem) {
+		emplace_back(move(elem));
+	}
 
-			vector<T> vec;
-			vec.reserve(nElems + 1);
-			for (size_t i = 0; i < nElems; i++) {
-				vec.push_back(move(inlineStorage->elems[i]));
-			}
-			//storage.emplace(move(vec));
-			storage = move(vec);
+	/**
+	 * Appends a new element that is constructed from the given arguments.
+	 * Within the inline storage, the element is assigned to an already existing one.
+	 *
+	 * @param args
+	 * @return A reference to the new element.
+	 */
+	template<typename... Args>
+	T& emplace_back(Args&&... args) {
+		if (InlineStorage * const inlineStorage = prepareInsertion()) {
+			T& elem = inlineStorage->elems[inlineStorage->nElems];
+			elem = T(forward<Args>(args)...);
+			inlineStorage->nElems++;
+			return elem;
 		}
 
 		//Storage is not inline but in a vector instead.
 		//Just add to that.
-		get<vector<T>>(storage).push_back(elem);
+		return get<HeapStorage>(storage.elems).emplace_back(forward<Args>(args)...);
+	}
+
+	/**
+	 * Removes the last element. There must be one.
+	 */
+	void pop_back() {
+		assert(!empty());
+		if (InlineStorage * const inlineStorage = get_if<InlineStorage>(&storage.elems)) {
+			inlineStorage->nElems--;
+		} else {
+			get<HeapStorage>(storage.elems).pop_back();
+		}
+	}
+
+	/**
+	 * Makes sure that this InlineStorageVector can hold the given number of elements
+	 * without allocating memory. Moves the elements to a vector if they don't fit
+	 * into the inline storage.
+	 *
+	 * @param capacity
+	 */
+	void reserve(size_t capacity) {
+		if (capacity <= this->capacity()) {
+			return;
+		}
+
+		if (holds_alternative<InlineStorage>(storage.elems)) {
+			moveToHeap(capacity);
+		} else {
+			get<HeapStorage>(storage.elems).reserve(capacity);
+		}
+	}
+
+	/**
+	 * @return The number of elements that fit into this InlineStorageVector without allocating memory.
+	 */
+	size_t capacity() const {
+		if (holds_alternative<InlineStorage>(storage.elems)) {
+			return numInlineElements;
+		} else {
+			return get<HeapStorage>(storage.elems).capacity();
+		}
 	}
 
 	/**
 	 * @return The number of elements.
 	 */
 	size_t size() const {
-		if (const InlineStorage * const inlineStorage = get_if<InlineStorage>(&storage)) {
+		if (const InlineStorage * const inlineStorage = get_if<InlineStorage>(&storage.elems)) {
 			return inlineStorage->nElems;
 		} else {
-			return get<vector<T>>(storage).size();
+			return get<HeapStorage>(storage.elems).size();
 		}
 	}
 
+	/**
+	 * @return True if there are no elements.
+	 */
+	bool empty() const {
+		return size() == 0;
+	}
+
 	/**
 	 * @param i The index of the element to get. Must be within bounds.
 	 * @return A reference to the i-th element of this InlineStorageVector.
 	 */
 	T& operator[](size_t i) {
-		if (InlineStorage * const inlineStorage = get_if<InlineStorage>(storage)) {
-			return inlineStorage->elems[i];
-		} else {
-			return get<vector<T>>(storage)[i];
-		}
+		return data()[i];
 	}
 
 	/**
 	 * @param i The index of the element to get. Must be within bounds.
 	 * @return A reference to the i-th element of this InlineStorageVector.
 	 */
-	const T& operator[](size_t index) const {
-		if (const InlineStorage * const inlineStorage = get_if<InlineStorage>(&storage)) {
-			return inlineStorage->elems[index];
-		} else {
-			return get<vector<T>>(storage)[index];
+	const T& operator[](size_t i) const {
+		return data()[i];
+	}
+
+	/**
+	 * @return A reference to the last element. There must be one.
+	 */
+	T& back() {
+		assert(!empty());
+		return end()[-1];
+	}
+
+	/**
+	 * @return A reference to the last element. There must be one.
+	 */
+	const T& back() const {
+		assert(!empty());
+		return end()[-1];
+	}
+
+	/**
+	 * Removes the first element that compares equal to the given one.
+	 * The last element takes its place, so the order of the elements is not preserved.
+	 *
+	 * @param elem
+	 * @return True if an element has been removed, false if there was none.
+	 */
+	bool remove(const T& elem) {
+		T * const first = begin();
+		T * const last = end();
+		T * const found = find(first, last, elem);
+		if (found == last) {
+			return false;
 		}
+
+		*found = move(*(last - 1));
+		pop_back();
+		return true;
 	}
 
 	/**
 	 * Clears this InlineStorageVector.
-	 * After invoking this method, the size of this InlineStorageVector will be 0
-	 * and its storage will be inline.
+	 * After invoking this method, the size of this InlineStorageVector will be 0.
+	 *
+	 * @param keepCapacity False to free the vector the elements have been moved to, if any, so
+	 *                     the storage is inline again. True to keep it, so the elements don't
+	 *                     have to be moved again when it fills up the next time.
 	 */
-	void clear() {
-		storage.template emplace<InlineStorage>();
+	void clear(bool keepCapacity = false) {
+		if (keepCapacity) {
+			if (HeapStorage * const heapStorage = get_if<HeapStorage>(&storage.elems)) {
+				heapStorage->clear();
+				return;
+			}
+		}
+		storage.elems.template emplace<InlineStorage>();
 	}
 
-	T * begin() {
-		if (InlineStorage * const inlineStorage = get_if<InlineStorage>(&storage)) {
+	T * data() {
+		if (InlineStorage * const inlineStorage = get_if<InlineStorage>(&storage.elems)) {
 			return inlineStorage->elems;
 		} else {
-			return get<vector<T>>(storage).data();
+			return get<HeapStorage>(storage.elems).data();
 		}
 	}
 
+	const T * data() const {
+		if (const InlineStorage * const inlineStorage = get_if<InlineStorage>(&storage.elems)) {
+			return inlineStorage->elems;
+		} else {
+			return get<HeapStorage>(storage.elems).data();
+		}
+	}
+
+	T * begin() {
+		return data();
+	}
+
 	T * end() {
-		return begin() + size();
+		return data() + size();
+	}
+
+	const T * begin() const {
+		return data();
+	}
+
+	const T * end() const {
+		return data() + size();
 	}
-};
 
+	const T * cbegin() const {
+		return begin();
+	}
+
+	const T * cend() const {
+		return end();
+	}
+};
 }
 
 
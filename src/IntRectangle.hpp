@@ -91,6 +91,26 @@ struct IntRectangle {
 
 		return result;
 	}
+
+	/**
+	 * @param other
+	 * @return The smallest IntRectangle that contains both this IntRectangle and the other. Empty rectangles are ignored.
+	 */
+	IntRectangle<Coord> getBoundingBox(const IntRectangle<Coord>& other) const {
+		if (other.isEmpty()) return *this;
+		if (isEmpty()) return other;
+
+		IntRectangle<Coord> result;
+		result.x = min(x, other.x);
+		result.y = min(y, other.y);
+		Coord lastX = max(getLastX(), other.getLastX());
+		Coord lastY = max(getLastY(), other.getLastY());
+
+		result.width = lastX - result.x + 1;
+		result.height = lastY - result.y + 1;
+
+		return result;
+	}
 };
 
 }
@@ -0,0 +1,69 @@
+/*
+ * LoadBalance.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef LOADBALANCE_HPP_
+#define LOADBALANCE_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+
+using namespace std;
+
+namespace mmo2020 {
+
+
+/**
+ * How the rendering work of a frame was spread over the threads, for checking how well
+ * the estimated costs that the work is balanced by match the actual cost.
+ *
+ * A task is a block of lines, a line or a tile, depending on how the frame was rendered.
+ * Estimated costs are in nanoseconds if they are based on the measurements of the previous
+ * frame, otherwise in arbitrary units, see SpriteRenderer::setCostMeasurement.
+ */
+struct LoadBalance {
+	/**
+	 * Per task: the estimated cost, the measured time in nanoseconds and the index of the thread that ran it.
+	 */
+	vector<uint64_t> estimatedCosts;
+	vector<uint64_t> measuredNanos;
+	vector<int> threadIndices;
+
+	/**
+	 * Per thread of the task pool: the sums of the estimated costs and of the measured times of its tasks.
+	 */
+	vector<uint64_t> threadEstimatedCosts;
+	vector<uint64_t> threadMeasuredNanos;
+
+	/**
+	 * @return The busiest thread's measured time divided by the average over all threads.
+	 *         1 for perfectly balanced work, the number of threads if one thread did everything.
+	 */
+	double getImbalance() const {
+		const uint64_t total = accumulate(threadMeasuredNanos.begin(), threadMeasuredNanos.end(), (uint64_t)0);
+		if (total == 0) {
+			return 1;
+		}
+		const uint64_t busiest = *max_element(threadMeasuredNanos.begin(), threadMeasuredNanos.end());
+		return (double)busiest * threadMeasuredNanos.size() / total;
+	}
+
+	void clear() {
+		estimatedCosts.clear();
+		measuredNanos.clear();
+		threadIndices.clear();
+		threadEstimatedCosts.clear();
+		threadMeasuredNanos.clear();
+	}
+};
+
+
+}
+
+
+#endif /* LOADBALANCE_HPP_ */
@@ -0,0 +1,458 @@
+/*
+ * PixelFormat.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef PIXELFORMAT_HPP_
+#define PIXELFORMAT_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "SpritePixel.hpp"
+
+using namespace std;
+
+namespace mmo2020 {
+
+
+/**
+ * Packs R, G and B values into an opaque pixel represented as an uint32_t.
+ */
+using PixelPacker = uint32_t(uint8_t r, uint8_t g, uint8_t b);
+
+/**
+ * Framebuffer formats that rows of pixels can be packed into without
+ * calling a PixelPacker for each pixel.
+ */
+enum class PixelFormat {
+	/**
+	 * 32 bits per pixel, 0xAARRGGBB.
+	 */
+	ARGB8888,
+
+	/**
+	 * 32 bits per pixel, 0xAABBGGRR.
+	 */
+	ABGR8888,
+
+	/**
+	 * 16 bits per pixel, 0bRRRRRGGGGGGBBBBB.
+	 */
+	RGB565,
+
+	/**
+	 * 32 bits per pixel, packed by a PixelPacker.
+	 */
+	Custom
+};
+
+/**
+ * @param format
+ * @return The number of bytes that one pixel of the given format takes up in the framebuffer.
+ */
+constexpr size_t getBytesPerPixel(PixelFormat format) {
+	return (format == PixelFormat::RGB565) ? 2 : 4;
+}
+
+/*
+ * The row kernels below all treat a SpritePixel as a little-endian uint32_t
+ * 0xAABBGGRR. The rows they pack hold the colors of the composited sprites on
+ * a black background (see Blending.hpp), so the alpha is ignored and every pixel
+ * is written as opaque.
+ */
+static_assert(sizeof(SpritePixel) == 4, "The row packing kernels expect SpritePixels to be 4 bytes large");
+
+/**
+ * @param pixel
+ * @return The pixel's bytes as an uint32_t without the alpha.
+ */
+inline uint32_t getSpritePixelColorBits(const SpritePixel& pixel) {
+	uint32_t bits;
+	memcpy(&bits, &pixel, sizeof(bits));
+	return bits & 0x00FFFFFF;
+}
+
+/**
+ * Packs a row of pixels as ARGB8888.
+ *
+ * @param pixels
+ * @param count
+ * @param target
+ */
+inline void packRowARGB8888(const SpritePixel *pixels, int count, uint32_t *target) {
+	int i = 0;
+
+#if defined(__AVX2__)
+	const __m256i alpha8 = _mm256_set1_epi32(0xFF000000);
+	const __m256i byteMask8 = _mm256_set1_epi32(0xFF);
+	const __m256i greenMask8 = _mm256_set1_epi32(0xFF00);
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(pixels + i));
+		__m256i r = _mm256_slli_epi32(_mm256_and_si256(v, byteMask8), 16);
+		__m256i g = _mm256_and_si256(v, greenMask8);
+		__m256i b = _mm256_and_si256(_mm256_srli_epi32(v, 16), byteMask8);
+		__m256i out = _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, alpha8));
+		_mm256_storeu_si256((__m256i *)(target + i), out);
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+	const __m128i byteMask = _mm_set1_epi32(0xFF);
+	const __m128i greenMask = _mm_set1_epi32(0xFF00);
+	for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(pixels + i));
+		__m128i r = _mm_slli_epi32(_mm_and_si128(v, byteMask), 16);
+		__m128i g = _mm_and_si128(v, greenMask);
+		__m128i b = _mm_and_si128(_mm_srli_epi32(v, 16), byteMask);
+		__m128i out = _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, alpha));
+		_mm_storeu_si128((__m128i *)(target + i), out);
+	}
+#endif
+
+#if defined(__ARM_NEON)
+	const uint8x16_t alphaNeon = vdupq_n_u8(0xFF);
+	for (; i + 16 <= count; i += 16) {
+		uint8x16x4_t v = vld4q_u8((const uint8_t *)(pixels + i));
+		uint8x16x4_t out;
+		out.val[0] = v.val[2];
+		out.val[1] = v.val[1];
+		out.val[2] = v.val[0];
+		out.val[3] = alphaNeon;
+		vst4q_u8((uint8_t *)(target + i), out);
+	}
+#endif
+
+	for (; i < count; i++) {
+		const uint32_t bits = getSpritePixelColorBits(pixels[i]);
+		target[i] = 0xFF000000 | ((bits & 0xFF) << 16) | (bits & 0xFF00) | ((bits >> 16) & 0xFF);
+	}
+}
+
+/**
+ * Packs a row of pixels as ABGR8888.
+ *
+ * @param pixels
+ * @param count
+ * @param target
+ */
+inline void packRowABGR8888(const SpritePixel *pixels, int count, uint32_t *target) {
+	int i = 0;
+
+#if defined(__AVX2__)
+	const __m256i alpha8 = _mm256_set1_epi32(0xFF000000);
+	for (; i + 8 <= count; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(pixels + i));
+		_mm256_storeu_si256((__m256i *)(target + i), _mm256_or_si256(v, alpha8));
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i alpha = _mm_set1_epi32(0xFF000000);
+	for (; i + 4 <= count; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(pixels + i));
+		_mm_storeu_si128((__m128i *)(target + i), _mm_or_si128(v, alpha));
+	}
+#endif
+
+#if defined(__ARM_NEON)
+	const uint8x16_t alphaNeon = vdupq_n_u8(0xFF);
+	for (; i + 16 <= count; i += 16) {
+		uint8x16x4_t v = vld4q_u8((const uint8_t *)(pixels + i));
+		v.val[3] = alphaNeon;
+		vst4q_u8((uint8_t *)(target + i), v);
+	}
+#endif
+
+	for (; i < count; i++) {
+		target[i] = 0xFF000000 | getSpritePixelColorBits(pixels[i]);
+	}
+}
+
+/**
+ * Packs a row of pixels as RGB565.
+ *
+ * @param pixels
+ * @param count
+ * @param target
+ */
+inline void packRowRGB565(const SpritePixel *pixels, int count, uint16_t *target) {
+	int i = 0;
+
+#if defined(__AVX2__)
+	const __m256i redMask8 = _mm256_set1_epi32(0xF8);
+	const __m256i greenMask8 = _mm256_set1_epi32(0xFC00);
+	const __m256i blueMask8 = _mm256_set1_epi32(0xF80000);
+	for (; i + 16 <= count; i += 16) {
+		__m256i packed[2];
+		for (int half = 0; half < 2; half++) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(pixels + i + half * 8));
+			__m256i r = _mm256_slli_epi32(_mm256_and_si256(v, redMask8), 8);
+			__m256i g = _mm256_srli_epi32(_mm256_and_si256(v, greenMask8), 5);
+			__m256i b = _mm256_srli_epi32(_mm256_and_si256(v, blueMask8), 19);
+			__m256i rgb = _mm256_or_si256(_mm256_or_si256(r, g), b);
+			//Sign-extend the lower 16 bits so the saturating pack below keeps them as they are.
+			packed[half] = _mm256_srai_epi32(_mm256_slli_epi32(rgb, 16), 16);
+		}
+		//The pack works within 128 bit lanes, so the 64 bit quarters need to be put back in order.
+		__m256i out = _mm256_permute4x64_epi64(_mm256_packs_epi32(packed[0], packed[1]), 0xD8);
+		_mm256_storeu_si256((__m256i *)(target + i), out);
+	}
+#endif
+
+#if defined(__SSE2__)
+	const __m128i redMask = _mm_set1_epi32(0xF8);
+	const __m128i greenMask = _mm_set1_epi32(0xFC00);
+	const __m128i blueMask = _mm_set1_epi32(0xF80000);
+	for (; i + 8 <= count; i += 8) {
+		__m128i packed[2];
+		for (int half = 0; half < 2; half++) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(pixels + i + half * 4));
+			__m128i r = _mm_slli_epi32(_mm_and_si128(v, redMask), 8);
+			__m128i g = _mm_srli_epi32(_mm_and_si128(v, greenMask), 5);
+			__m128i b = _mm_srli_epi32(_mm_and_si128(v, blueMask), 19);
+			__m128i rgb = _mm_or_si128(_mm_or_si128(r, g), b);
+			//Sign-extend the lower 16 bits so the saturating pack below keeps them as they are.
+			packed[half] = _mm_srai_epi32(_mm_slli_epi32(rgb, 16), 16);
+		}
+		_mm_storeu_si128((__m128i *)(target + i), _mm_packs_epi32(packed[0], packed[1]));
+	}
+#endif
+
+#if defined(__ARM_NEON)
+	for (; i + 8 <= count; i += 8) {
+		uint8x8x4_t v = vld4_u8((const uint8_t *)(pixels + i));
+		uint16x8_t r = vshll_n_u8(vand_u8(v.val[0], vdup_n_u8(0xF8)), 8);
+		uint16x8_t g = vshlq_n_u16(vmovl_u8(vand_u8(v.val[1], vdup_n_u8(0xFC))), 3);
+		uint16x8_t b = vmovl_u8(vshr_n_u8(v.val[2], 3));
+		vst1q_u16(target + i, vorrq_u16(vorrq_u16(r, g), b));
+	}
+#endif
+
+	for (; i < count; i++) {
+		const uint32_t bits = getSpritePixelColorBits(pixels[i]);
+		target[i] = ((bits & 0xF8) << 8) | ((bits & 0xFC00) >> 5) | ((bits & 0xF80000) >> 19);
+	}
+}
+
+/**
+ * @param pixel The address of a pixel in the framebuffer.
+ * @return The pixel's bytes as a native uint32_t.
+ */
+inline uint32_t loadPixel32(const uint8_t *pixel) {
+	uint32_t bits;
+	memcpy(&bits, pixel, sizeof(bits));
+	return bits;
+}
+
+/*
+ * Pixel format policies for SpriteRenderer. Each policy provides
+ * getBytesPerPixel() and packRow(pixels, count, target), which packs a row
+ * of composited SpritePixels into the framebuffer, ignoring their alpha,
+ * as well as canUnpack() and unpack(pixel), which reads a pixel of the
+ * framebuffer back as an opaque SpritePixel, e.g. to blend sprites over it.
+ *
+ * The policies for fixed formats only have static members, so the packing code
+ * gets inlined into the render loop. RowPacker picks the format at runtime.
+ */
+
+/**
+ * 32 bits per pixel, 0xAARRGGBB.
+ */
+struct ARGB8888Format {
+	static constexpr PixelFormat format = PixelFormat::ARGB8888;
+
+	static constexpr size_t getBytesPerPixel() {
+		return 4;
+	}
+
+	static constexpr uint32_t pack(uint8_t r, uint8_t g, uint8_t b) {
+		return 0xFF000000 | ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+	}
+
+	static void packRow(const SpritePixel *pixels, int count, uint8_t *target) {
+		packRowARGB8888(pixels, count, (uint32_t *)target);
+	}
+
+	static constexpr bool canUnpack() {
+		return true;
+	}
+
+	static SpritePixel unpack(const uint8_t *pixel) {
+		const uint32_t bits = loadPixel32(pixel);
+		return SpritePixel((bits >> 16) & 0xFF, (bits >> 8) & 0xFF, bits & 0xFF);
+	}
+};
+
+/**
+ * 32 bits per pixel, 0xAABBGGRR.
+ */
+struct ABGR8888Format {
+	static constexpr PixelFormat format = PixelFormat::ABGR8888;
+
+	static constexpr size_t getBytesPerPixel() {
+		return 4;
+	}
+
+	static constexpr uint32_t pack(uint8_t r, uint8_t g, uint8_t b) {
+		return 0xFF000000 | ((uint32_t)b << 16) | ((uint32_t)g << 8) | r;
+	}
+
+	static void packRow(const SpritePixel *pixels, int count, uint8_t *target) {
+		packRowABGR8888(pixels, count, (uint32_t *)target);
+	}
+
+	static constexpr bool canUnpack() {
+		return true;
+	}
+
+	static SpritePixel unpack(const uint8_t *pixel) {
+		const uint32_t bits = loadPixel32(pixel);
+		return SpritePixel(bits & 0xFF, (bits >> 8) & 0xFF, (bits >> 16) & 0xFF);
+	}
+};
+
+/**
+ * 16 bits per pixel, 0bRRRRRGGGGGGBBBBB.
+ */
+struct RGB565Format {
+	static constexpr PixelFormat format = PixelFormat::RGB565;
+
+	static constexpr size_t getBytesPerPixel() {
+		return 2;
+	}
+
+	static constexpr uint16_t pack(uint8_t r, uint8_t g, uint8_t b) {
+		return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+	}
+
+	static void packRow(const SpritePixel *pixels, int count, uint8_t *target) {
+		packRowRGB565(pixels, count, (uint16_t *)target);
+	}
+
+	static constexpr bool canUnpack() {
+		return true;
+	}
+
+	static SpritePixel unpack(const uint8_t *pixel) {
+		uint16_t bits;
+		memcpy(&bits, pixel, sizeof(bits));
+
+		//Repeat the upper bits in the missing lower ones, so white stays white.
+		const uint32_t r = bits >> 11, g = (bits >> 5) & 0x3F, b = bits & 0x1F;
+		return SpritePixel((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+	}
+};
+
+/**
+ * Pixel format policy that decides at runtime how to pack rows of SpritePixels
+ * into the framebuffer, either with one of the vectorized kernels for the known
+ * PixelFormats or with a PixelPacker.
+ */
+class RowPacker {
+private:
+	PixelFormat format;
+	PixelPacker *pixelPacker;
+
+public:
+	/**
+	 * @param format Must not be PixelFormat::Custom.
+	 */
+	RowPacker(PixelFormat format):
+		format(format), pixelPacker(nullptr)
+	{
+		assert(format != PixelFormat::Custom);
+	}
+
+	/**
+	 * @param pixelPacker The function to pack each pixel into an uint32_t with.
+	 */
+	RowPacker(PixelPacker *pixelPacker):
+		format(PixelFormat::Custom), pixelPacker(pixelPacker)
+	{
+		//Nothing else to do
+	}
+
+	PixelFormat getFormat() const {
+		return format;
+	}
+
+	size_t getBytesPerPixel() const {
+		return mmo2020::getBytesPerPixel(format);
+	}
+
+	/**
+	 * Packs a row of composited pixels. Their alpha is ignored.
+	 *
+	 * @param pixels
+	 * @param count
+	 * @param target The address of the first pixel to write within the framebuffer.
+	 */
+	void packRow(const SpritePixel *pixels, int count, uint8_t *target) const {
+		switch (format) {
+			case PixelFormat::ARGB8888:
+				ARGB8888Format::packRow(pixels, count, target);
+				break;
+			case PixelFormat::ABGR8888:
+				ABGR8888Format::packRow(pixels, count, target);
+				break;
+			case PixelFormat::RGB565:
+				RGB565Format::packRow(pixels, count, target);
+				break;
+			case PixelFormat::Custom: {
+				uint32_t *targetPixels = (uint32_t *)target;
+				for (int i = 0; i < count; i++) {
+					targetPixels[i] = pixelPacker(pixels[i].r, pixels[i].g, pixels[i].b);
+				}
+				break;
+			}
+		}
+	}
+
+	/**
+	 * @return False for PixelFormat::Custom, whose pixels can't be unpacked.
+	 */
+	bool canUnpack() const {
+		return format != PixelFormat::Custom;
+	}
+
+	/**
+	 * Reads a pixel of the framebuffer back. Not available for PixelFormat::Custom.
+	 *
+	 * @param pixel The address of the pixel within the framebuffer.
+	 * @return The pixel's color as an opaque SpritePixel.
+	 */
+	SpritePixel unpack(const uint8_t *pixel) const {
+		switch (format) {
+			case PixelFormat::ARGB8888:
+				return ARGB8888Format::unpack(pixel);
+			case PixelFormat::ABGR8888:
+				return ABGR8888Format::unpack(pixel);
+			case PixelFormat::RGB565:
+				return RGB565Format::unpack(pixel);
+			case PixelFormat::Custom:
+				break;
+		}
+		assert(false);
+		return SpritePixel(0, 0, 0);
+	}
+};
+
+
+}
+
+
+#endif /* PIXELFORMAT_HPP_ */
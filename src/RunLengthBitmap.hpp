@@ -0,0 +1,215 @@
+/*
+ * RunLengthBitmap.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef RUNLENGTHBITMAP_HPP_
+#define RUNLENGTHBITMAP_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <cassert>
+
+#include "SpritePixel.hpp"
+#include "SpriteBitmap.hpp"
+
+using namespace std;
+
+namespace mmo2020 {
+
+
+/**
+ * An image stored as runs of equal pixels, row by row. Much smaller than a SpriteBitmap for
+ * images that mostly consist of long runs of one color, like UI panels, bars and debug
+ * overlays, and much faster to sample: a span is filled run by run instead of pixel by pixel.
+ *
+ * Like a SpriteBitmap, a RunLengthBitmap is meant to be shared (via shared_ptr) between all sprites that use it.
+ */
+class RunLengthBitmap {
+private:
+	/**
+	 * A run of equal pixels that ends before column end. It begins where the previous run of its row ends.
+	 */
+	struct Run {
+		uint32_t end;
+		SpritePixel pixel;
+	};
+
+	uint32_t width, height;
+
+	/**
+	 * The index of the first run of each row, and the number of runs at the end.
+	 */
+	vector<size_t> rowBegins;
+
+	vector<Run> runs;
+
+	bool isFullyOpaque = true;
+
+	/**
+	 * @param x
+	 * @param y
+	 * @return The run of row y that contains column x.
+	 */
+	const Run * findRun(uint32_t x, uint32_t y) const {
+		const Run *rowEnd = runs.data() + rowBegins[y + 1];
+		return upper_bound(runs.data() + rowBegins[y], rowEnd, x, [](uint32_t x, const Run& run) {
+			return x < run.end;
+		});
+	}
+
+	/**
+	 * @param pixel
+	 * @return The pixel, or the default transparent pixel if it is transparent. Transparent pixels
+	 *         look the same whatever their color, so this lets them share runs.
+	 */
+	static SpritePixel normalize(SpritePixel pixel) {
+		return pixel.isTransparent() ? SpritePixel() : pixel;
+	}
+
+	static bool isSame(const SpritePixel& a, const SpritePixel& b) {
+		return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+	}
+
+	/**
+	 * Encodes the pixels returned by the given function.
+	 */
+	template<typename PixelGetter>
+	void encode(const PixelGetter& pixelGetter) {
+		rowBegins.reserve(height + 1);
+		for (uint32_t y = 0; y < height; y++) {
+			rowBegins.push_back(runs.size());
+			for (uint32_t x = 0; x < width; x++) {
+				const SpritePixel pixel = normalize(pixelGetter(x, y));
+				isFullyOpaque = isFullyOpaque && pixel.isOpaque();
+
+				if (x != 0 && isSame(runs.back().pixel, pixel)) {
+					runs.back().end = x + 1;
+				} else {
+					runs.push_back(Run{x + 1, pixel});
+				}
+			}
+		}
+		rowBegins.push_back(runs.size());
+	}
+
+public:
+	/**
+	 * Constructs a RunLengthBitmap from the pixels returned by the given function.
+	 *
+	 * @param width
+	 * @param height
+	 * @param pixelGetter Returns the pixel at the given coordinates.
+	 */
+	RunLengthBitmap(uint32_t width, uint32_t height, const function<SpritePixel(int x, int y)>& pixelGetter):
+		width(width), height(height)
+	{
+		encode(pixelGetter);
+	}
+
+	/**
+	 * Constructs a RunLengthBitmap with the same pixels as the given bitmap.
+	 *
+	 * @param bitmap
+	 */
+	explicit RunLengthBitmap(const SpriteBitmap& bitmap):
+		width(bitmap.getWidth()), height(bitmap.getHeight())
+	{
+		encode([&](uint32_t x, uint32_t y) {
+			return bitmap.getPixel(x, y);
+		});
+	}
+
+	uint32_t getWidth() const {
+		return width;
+	}
+
+	uint32_t getHeight() const {
+		return height;
+	}
+
+	/**
+	 * @return The number of runs of all rows.
+	 */
+	size_t getNumRuns() const {
+		return runs.size();
+	}
+
+	/**
+	 * @return True if every pixel is fully opaque.
+	 */
+	bool isOpaque() const {
+		return isFullyOpaque;
+	}
+
+	/**
+	 * @param x
+	 * @param y
+	 * @return The pixel at the given coordinates.
+	 */
+	SpritePixel getPixel(uint32_t x, uint32_t y) const {
+		assert(x < width && y < height);
+		return findRun(x, y)->pixel;
+	}
+
+	/**
+	 * Fetches count consecutive pixels of row y, starting at column x.
+	 * The span must lie entirely within the bitmap.
+	 *
+	 * @param x
+	 * @param y
+	 * @param count
+	 * @param pixels The buffer to write the pixels to. Must have room for count pixels.
+	 */
+	void getSpan(uint32_t x, uint32_t y, int count, SpritePixel *pixels) const {
+		assert(x + count <= width && y < height);
+
+		const uint32_t end = x + count;
+		for (const Run *run = findRun(x, y); x < end; run++) {
+			const uint32_t runEnd = min(run->end, end);
+			fill_n(pixels, runEnd - x, run->pixel);
+			pixels += runEnd - x;
+			x = runEnd;
+		}
+	}
+
+	/**
+	 * Fetches count pixels of row y, stepping through the row in fixed point, like SpriteBitmap::getSteppedSpan.
+	 *
+	 * @param x            The fixed point column of the first pixel.
+	 * @param step         The fixed point distance between two pixels. May be negative.
+	 * @param fractionBits The number of fractional bits of x and step.
+	 * @param y
+	 * @param count
+	 * @param pixels       The buffer to write the pixels to. Must have room for count pixels.
+	 */
+	void getSteppedSpan(int32_t x, int32_t step, int fractionBits, uint32_t y, int count, SpritePixel *pixels) const {
+		assert(y < height && count > 0);
+		assert(x >= 0 && (uint32_t)(x >> fractionBits) < width);
+		assert(x + (count - 1) * step >= 0 && (uint32_t)((x + (count - 1) * step) >> fractionBits) < width);
+
+		//Neighbouring pixels usually fall into the same run, so only look for another one when leaving it.
+		const Run *run = findRun(x >> fractionBits, y);
+		const Run *rowBegin = runs.data() + rowBegins[y];
+		for (int i = 0; i < count; i++) {
+			const uint32_t column = x >> fractionBits;
+			const uint32_t runBegin = (run == rowBegin) ? 0 : run[-1].end;
+			if (column < runBegin || column >= run->end) {
+				run = findRun(column, y);
+			}
+			pixels[i] = run->pixel;
+			x += step;
+		}
+	}
+};
+
+
+}
+
+
+#endif /* RUNLENGTHBITMAP_HPP_ */
@@ -0,0 +1,169 @@
+/*
+ * SpatialGrid.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef SPATIALGRID_HPP_
+#define SPATIALGRID_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cassert>
+
+#include "IntRectangle.hpp"
+
+using namespace std;
+
+namespace ttlhacker {
+
+
+/**
+ * A sparse uniform grid of rectangles with integer ids, for finding the rectangles that
+ * intersect a query rectangle without looking at all of them. Each rectangle is kept in
+ * every cell it overlaps, together with a copy of its coordinates, so queries never have
+ * to look anywhere else. Only the cells that contain rectangles take up memory, so the
+ * coordinates may span the entire range of int32_t.
+ *
+ * Rectangles much larger than a cell occupy many cells and make updating them expensive.
+ */
+class SpatialGrid {
+private:
+	struct Entry {
+		uint32_t id;
+		IntRectangle<int32_t> rect;
+	};
+
+	int32_t cellSize;
+	unordered_map<uint64_t, vector<Entry>> cells;
+
+	/**
+	 * @param coord
+	 * @return The index of the cell that contains the coordinate, rounded towards negative infinity.
+	 */
+	int32_t getCellIndex(int32_t coord) const {
+		return (coord >= 0) ? (coord / cellSize) : -((-(int64_t)coord - 1) / cellSize) - 1;
+	}
+
+	static uint64_t getCellKey(int32_t cellX, int32_t cellY) {
+		return ((uint64_t)(uint32_t)cellX << 32) | (uint32_t)cellY;
+	}
+
+	/**
+	 * Calls callback(cellX, cellY) for every cell that the given (non-empty) rectangle overlaps.
+	 */
+	template<typename Callback>
+	void forEachCell(const IntRectangle<int32_t>& rect, Callback callback) const {
+		const int32_t firstCellX = getCellIndex(rect.x);
+		const int32_t lastCellX = getCellIndex(rect.getLastX());
+		const int32_t firstCellY = getCellIndex(rect.y);
+		const int32_t lastCellY = getCellIndex(rect.getLastY());
+
+		for (int32_t cellY = firstCellY; cellY <= lastCellY; cellY++) {
+			for (int32_t cellX = firstCellX; cellX <= lastCellX; cellX++) {
+				callback(cellX, cellY);
+			}
+		}
+	}
+
+public:
+	/**
+	 * @param cellSize The width and height of each cell. Best somewhat larger than most rectangles.
+	 */
+	explicit SpatialGrid(int32_t cellSize):
+		cellSize(cellSize)
+	{
+		assert(cellSize > 0);
+	}
+
+	/**
+	 * Adds a rectangle. Empty rectangles are ignored.
+	 *
+	 * @param id
+	 * @param rect
+	 */
+	void insert(uint32_t id, const IntRectangle<int32_t>& rect) {
+		if (rect.isEmpty()) {
+			return;
+		}
+
+		forEachCell(rect, [&](int32_t cellX, int32_t cellY) {
+			cells[getCellKey(cellX, cellY)].push_back(Entry{id, rect});
+		});
+	}
+
+	/**
+	 * Removes a rectangle.
+	 *
+	 * @param id
+	 * @param rect The same rectangle that it was inserted with.
+	 */
+	void remove(uint32_t id, const IntRectangle<int32_t>& rect) {
+		if (rect.isEmpty()) {
+			return;
+		}
+
+		forEachCell(rect, [&](int32_t cellX, int32_t cellY) {
+			auto cell = cells.find(getCellKey(cellX, cellY));
+			assert(cell != cells.end());
+
+			vector<Entry>& entries = cell->second;
+			auto entry = find_if(entries.begin(), entries.end(), [&](const Entry& entry) {
+				return entry.id == id;
+			});
+			assert(entry != entries.end());
+
+			*entry = entries.back();
+			entries.pop_back();
+			if (entries.empty()) {
+				cells.erase(cell);
+			}
+		});
+	}
+
+	/**
+	 * Calls callback(id) exactly once for each rectangle that intersects the given one, in no particular order.
+	 *
+	 * @param rect
+	 * @param callback
+	 */
+	template<typename Callback>
+	void query(const IntRectangle<int32_t>& rect, Callback callback) const {
+		if (rect.isEmpty()) {
+			return;
+		}
+
+		forEachCell(rect, [&](int32_t cellX, int32_t cellY) {
+			auto cell = cells.find(getCellKey(cellX, cellY));
+			if (cell == cells.end()) {
+				return;
+			}
+
+			for (const Entry& entry: cell->second) {
+				if (!entry.rect.intersects(rect)) {
+					continue;
+				}
+
+				//A rectangle that spans several cells is only reported by the cell that contains
+				//the top left corner of its intersection with the query rectangle.
+				const int32_t firstX = max(entry.rect.x, rect.x);
+				const int32_t firstY = max(entry.rect.y, rect.y);
+				if (getCellIndex(firstX) == cellX && getCellIndex(firstY) == cellY) {
+					callback(entry.id);
+				}
+			}
+		});
+	}
+
+	void clear() {
+		cells.clear();
+	}
+};
+
+}
+
+
+#endif /* SPATIALGRID_HPP_ */
@@ -0,0 +1,555 @@
+/*
+ * Sprite.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef SPRITE_HPP_
+#define SPRITE_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <cassert>
+
+#include "IntRectangle.hpp"
+#include "SpritePixel.hpp"
+#include "SpriteBitmap.hpp"
+#include "RunLengthBitmap.hpp"
+#include "Blending.hpp"
+
+using namespace std;
+using namespace ttlhacker;
+
+namespace mmo2020 {
+
+
+/**
+ * Maps the pixels of a sprite on the screen to the texels of its source, for sprites that are
+ * scaled, flipped or show only part of their source. Texel coordinates are fixed point numbers,
+ * so stepping along a span takes one addition per pixel.
+ */
+struct TexelMapping {
+	static constexpr int fractionBits = 16;
+
+	/**
+	 * The fixed point texel coordinates of the sprite's top left pixel.
+	 */
+	int32_t firstX = 0, firstY = 0;
+
+	/**
+	 * The fixed point distances between the texels of two neighbouring pixels. Negative if flipped.
+	 */
+	int32_t stepX = 1 << fractionBits, stepY = 1 << fractionBits;
+
+	/**
+	 * True if each pixel shows the texel with the same coordinates. Such sprites are sampled without stepping.
+	 */
+	bool isIdentity = true;
+
+	TexelMapping() = default;
+
+	/**
+	 * Stretches the given rectangle of texels over a sprite of the given size. Each pixel
+	 * shows the texel that its center falls on.
+	 *
+	 * @param sourceRect The texels to show, relative to the source.
+	 * @param width      The width of the sprite on the screen.
+	 * @param height     The height of the sprite on the screen.
+	 * @param flipX      True to mirror the texels horizontally.
+	 * @param flipY      True to mirror the texels vertically.
+	 */
+	TexelMapping(IntRectangle<int32_t> sourceRect, uint32_t width, uint32_t height, bool flipX, bool flipY) {
+		assert(!sourceRect.isEmpty() && width != 0 && height != 0);
+		assert(sourceRect.x >= 0 && sourceRect.y >= 0);
+		assert(sourceRect.x + sourceRect.width < (1u << (31 - fractionBits)));
+		assert(sourceRect.y + sourceRect.height < (1u << (31 - fractionBits)));
+
+		initAxis(sourceRect.x, sourceRect.width, width, flipX, firstX, stepX);
+		initAxis(sourceRect.y, sourceRect.height, height, flipY, firstY, stepY);
+		isIdentity = (firstX == (1 << (fractionBits - 1)) && firstY == (1 << (fractionBits - 1)) && stepX == (1 << fractionBits) && stepY == (1 << fractionBits));
+		if (isIdentity) {
+			*this = TexelMapping();
+		}
+	}
+
+	/**
+	 * @param x Relative to the sprite.
+	 * @return The fixed point texel column of the given pixel.
+	 */
+	int32_t getTexelX(int x) const {
+		return firstX + x * stepX;
+	}
+
+	/**
+	 * @param y Relative to the sprite.
+	 * @return The texel row of the given pixel.
+	 */
+	int32_t getTexelY(int y) const {
+		return (firstY + y * stepY) >> fractionBits;
+	}
+
+private:
+	static void initAxis(int32_t sourceFirst, uint32_t sourceSize, uint32_t size, bool flip, int32_t& first, int32_t& step) {
+		//Rounded down, so the last pixel never steps past the last texel.
+		const int32_t absStep = ((int64_t)sourceSize << fractionBits) / size;
+		assert(absStep > 0);
+
+		if (flip) {
+			first = ((sourceFirst + (int32_t)sourceSize) << fractionBits) - 1 - (absStep - 1) / 2;
+			step = -absStep;
+		} else {
+			first = (sourceFirst << fractionBits) + absStep / 2;
+			step = absStep;
+		}
+	}
+};
+
+/**
+ * Where the pixels of a sprite come from. Doesn't know where on the screen they go,
+ * so one source can be shared by many sprites, see SpriteArray.
+ */
+struct SpriteSource {
+	/**
+	 * Given relative coordinates into the sprite, returns
+	 * the pixel at those coordinates.
+	 */
+	using PixelGetter = function<SpritePixel(int x, int y)>;
+
+	/**
+	 * Given relative coordinates into the sprite, writes count consecutive
+	 * pixels of row y, starting at column x, into the given buffer.
+	 * The requested span always lies entirely within the sprite.
+	 */
+	using SpanGetter = function<void(int x, int y, int count, SpritePixel *pixels)>;
+
+	/**
+	 * Per-pixel source. Only used if spanGetter is empty.
+	 */
+	PixelGetter pixelGetter;
+
+	/**
+	 * Batched source. If set, the renderer uses this instead of the pixelGetter
+	 * and fetches each visible run of pixels with a single call.
+	 */
+	SpanGetter spanGetter;
+
+	/**
+	 * Bitmap source. If set, the renderer reads the sprite's pixels straight from
+	 * this bitmap instead of using the pixelGetter or spanGetter.
+	 */
+	shared_ptr<const SpriteBitmap> bitmap;
+
+	/**
+	 * The position of the sprite's top left pixel within the bitmap.
+	 * Allows many sprites to share one atlas.
+	 */
+	int32_t bitmapX = 0, bitmapY = 0;
+
+	/**
+	 * Run-length encoded source. If set, the renderer fills the sprite's pixels run by run
+	 * from this bitmap instead of using any of the other sources.
+	 */
+	shared_ptr<const RunLengthBitmap> runLengthBitmap;
+
+	/**
+	 * Solid source: if isSolid is set, every pixel of the sprite is solidColor, and the renderer
+	 * fills spans with it instead of using any of the other sources.
+	 */
+	bool isSolid = false;
+	SpritePixel solidColor;
+
+	/**
+	 * Hint that all pixels of this sprite are fully opaque. The renderer won't look at anything
+	 * below an opaque sprite and can render longer runs over it.
+	 * Set automatically for bitmap sprites.
+	 */
+	bool isOpaque = false;
+
+	SpriteSource(PixelGetter pixelGetter):
+		pixelGetter(move(pixelGetter))
+	{
+		//Nothing else to initialize
+	}
+
+	SpriteSource(SpanGetter spanGetter):
+		spanGetter(move(spanGetter))
+	{
+		//Nothing else to initialize
+	}
+
+	/**
+	 * Constructs a source whose pixels all have the given color.
+	 *
+	 * @param solidColor
+	 */
+	SpriteSource(SpritePixel solidColor):
+		isSolid(true), solidColor(solidColor)
+	{
+		isOpaque = solidColor.isOpaque();
+	}
+
+	/**
+	 * Constructs a source that shows the given run-length encoded bitmap, starting at its top left pixel.
+	 *
+	 * @param runLengthBitmap Sprites using this source must not be larger than it.
+	 */
+	SpriteSource(shared_ptr<const RunLengthBitmap> runLengthBitmap):
+		runLengthBitmap(move(runLengthBitmap))
+	{
+		assert(this->runLengthBitmap);
+		isOpaque = this->runLengthBitmap->isOpaque();
+	}
+
+	/**
+	 * Constructs a source that shows a width x height region
+	 * of the given bitmap, starting at (bitmapX, bitmapY).
+	 *
+	 * @param bitmap  The bitmap (or atlas) to take the pixels from. The region must lie within the bitmap.
+	 * @param bitmapX
+	 * @param bitmapY
+	 * @param width   The width of the region. Sprites using this source must not be wider.
+	 * @param height  The height of the region. Sprites using this source must not be higher.
+	 */
+	SpriteSource(shared_ptr<const SpriteBitmap> bitmap, int32_t bitmapX, int32_t bitmapY, uint32_t width, uint32_t height):
+		bitmap(move(bitmap)), bitmapX(bitmapX), bitmapY(bitmapY)
+	{
+		assert(this->bitmap);
+		assert(bitmapX >= 0 && bitmapY >= 0);
+		assert(bitmapX + width <= this->bitmap->getWidth());
+		assert(bitmapY + height <= this->bitmap->getHeight());
+
+		isOpaque = this->bitmap->isRegionOpaque(bitmapX, bitmapY, width, height);
+	}
+
+	/**
+	 * @return True if this source can deliver whole spans of pixels at once.
+	 */
+	bool hasSpanGetter() const {
+		return (bool)spanGetter;
+	}
+
+	/**
+	 * @return True if fetching a span of pixels from this source costs much less than fetching
+	 *         them one by one, i.e. for everything but a pixelGetter.
+	 */
+	bool hasFastSpans() const {
+		return isSolid || runLengthBitmap || bitmap || spanGetter;
+	}
+
+	/**
+	 * Fetches count consecutive pixels of row y, starting at column x.
+	 * Coordinates are relative to the sprite. Uses the solid color or one of the bitmaps
+	 * if there is one, then the spanGetter, and falls back to calling the pixelGetter for each pixel.
+	 *
+	 * @param x
+	 * @param y
+	 * @param count
+	 * @param pixels The buffer to write the pixels to. Must have room for count pixels.
+	 */
+	void getSpan(int x, int y, int count, SpritePixel *pixels) const {
+		if (isSolid) {
+			fill_n(pixels, count, solidColor);
+			return;
+		}
+
+		if (runLengthBitmap) {
+			runLengthBitmap->getSpan(x, y, count, pixels);
+			return;
+		}
+
+		if (bitmap) {
+			bitmap->getSpan(bitmapX + x, bitmapY + y, count, pixels);
+			return;
+		}
+
+		if (spanGetter) {
+			spanGetter(x, y, count, pixels);
+			return;
+		}
+
+		for (int i = 0; i < count; i++) {
+			pixels[i] = pixelGetter(x + i, y);
+		}
+	}
+
+	/**
+	 * Fetches count consecutive pixels of row y of a sprite, starting at column x,
+	 * and maps them to the texels of this source with the given mapping.
+	 * Bitmaps are stepped through directly, and solid sources don't need any mapping.
+	 * Getters are asked for one texel at a time, unless the sprite is only flipped.
+	 *
+	 * @param mapping
+	 * @param x       Relative to the sprite.
+	 * @param y       Relative to the sprite.
+	 * @param count
+	 * @param pixels  The buffer to write the pixels to. Must have room for count pixels.
+	 */
+	void getSpan(const TexelMapping& mapping, int x, int y, int count, SpritePixel *pixels) const {
+		if (mapping.isIdentity || isSolid) {
+			getSpan(x, y, count, pixels);
+			return;
+		}
+		if (count <= 0) return;
+
+		constexpr int fractionBits = TexelMapping::fractionBits;
+		int32_t texelX = mapping.getTexelX(x);
+		const int32_t texelY = mapping.getTexelY(y);
+
+		if (runLengthBitmap) {
+			runLengthBitmap->getSteppedSpan(texelX, mapping.stepX, fractionBits, texelY, count, pixels);
+			return;
+		}
+
+		if (bitmap) {
+			bitmap->getSteppedSpan(texelX + (bitmapX << fractionBits), mapping.stepX, fractionBits, bitmapY + texelY, count, pixels);
+			return;
+		}
+
+		if (spanGetter && mapping.stepX == -(1 << fractionBits)) {
+			//Mirrored only, so the texels are still consecutive, just in reverse.
+			spanGetter((texelX >> fractionBits) - (count - 1), texelY, count, pixels);
+			reverse(pixels, pixels + count);
+			return;
+		}
+
+		for (int i = 0; i < count; i++) {
+			const int texelColumn = texelX >> fractionBits;
+			if (spanGetter) {
+				spanGetter(texelColumn, texelY, 1, pixels + i);
+			} else {
+				pixels[i] = pixelGetter(texelColumn, texelY);
+			}
+			texelX += mapping.stepX;
+		}
+	}
+
+	/**
+	 * @param mapping
+	 * @param x       Relative to the sprite.
+	 * @param y       Relative to the sprite.
+	 * @return The pixel of the sprite at the given coordinates, mapped to the texels of this source.
+	 */
+	SpritePixel getPixel(const TexelMapping& mapping, int x, int y) const {
+		if (!hasFastSpans()) {
+			return pixelGetter(mapping.getTexelX(x) >> TexelMapping::fractionBits, mapping.getTexelY(y));
+		}
+
+		SpritePixel pixel;
+		getSpan(mapping, x, y, 1, &pixel);
+		return pixel;
+	}
+};
+
+/**
+ * A sprite to draw to the screen.
+ */
+struct Sprite: SpriteSource {
+	IntRectangle<int32_t> position;
+
+	/**
+	 * Sprites on higher layers are drawn on top. Of two sprites on the same layer, the one that comes
+	 * later in the input is drawn on top, as if the sprites were drawn one after another: the later
+	 * one in the vector or SpriteArray, or the one in the higher slot of a SpriteScene.
+	 */
+	uint32_t layer;
+
+	/**
+	 * Multiplied with the alpha of every pixel of the sprite. 255 to show the pixels as they are.
+	 */
+	uint8_t opacity = 0xFF;
+
+	BlendMode blendMode = BlendMode::Normal;
+
+	/**
+	 * The texels of the source to show, relative to the source. They are stretched over the
+	 * sprite's position, so sprites can be scaled. Must lie within the source.
+	 * If empty (the default), the sprite shows as many texels as it is large, starting at (0, 0).
+	 */
+	IntRectangle<int32_t> sourceRect;
+
+	/**
+	 * Mirror the texels horizontally or vertically.
+	 */
+	bool flipX = false, flipY = false;
+
+	Sprite(IntRectangle<int32_t> position, PixelGetter pixelGetter, uint32_t layer):
+		SpriteSource(move(pixelGetter)), position(position), layer(layer)
+	{
+		//Nothing else to initialize
+	}
+
+	Sprite(IntRectangle<int32_t> position, SpanGetter spanGetter, uint32_t layer):
+		SpriteSource(move(spanGetter)), position(position), layer(layer)
+	{
+		//Nothing else to initialize
+	}
+
+	/**
+	 * Constructs a sprite that shows a position.width x position.height region
+	 * of the given bitmap, starting at (bitmapX, bitmapY).
+	 *
+	 * @param position
+	 * @param bitmap   The bitmap (or atlas) to take the pixels from. The region must lie within the bitmap.
+	 * @param bitmapX
+	 * @param bitmapY
+	 * @param layer
+	 */
+	Sprite(IntRectangle<int32_t> position, shared_ptr<const SpriteBitmap> bitmap, int32_t bitmapX, int32_t bitmapY, uint32_t layer):
+		SpriteSource(move(bitmap), bitmapX, bitmapY, position.width, position.height), position(position), layer(layer)
+	{
+		//Nothing else to initialize
+	}
+
+	/**
+	 * Constructs a sprite that shows the given region of the given bitmap, stretched over position.
+	 *
+	 * @param position
+	 * @param bitmap     The bitmap (or atlas) to take the pixels from.
+	 * @param bitmapRect The region of the bitmap to show. Must lie within the bitmap.
+	 * @param layer
+	 */
+	Sprite(IntRectangle<int32_t> position, shared_ptr<const SpriteBitmap> bitmap, IntRectangle<int32_t> bitmapRect, uint32_t layer):
+		SpriteSource(move(bitmap), bitmapRect.x, bitmapRect.y, bitmapRect.width, bitmapRect.height), position(position), layer(layer),
+		sourceRect(0, 0, bitmapRect.width, bitmapRect.height)
+	{
+		//Nothing else to initialize
+	}
+
+	/**
+	 * @return The mapping from the sprite's pixels to the texels of its source.
+	 */
+	TexelMapping getTexelMapping() const {
+		if (sourceRect.isEmpty()) {
+			if (!flipX && !flipY) {
+				return TexelMapping();
+			}
+			return TexelMapping(IntRectangle<int32_t>(0, 0, position.width, position.height), position.width, position.height, flipX, flipY);
+		}
+		return TexelMapping(sourceRect, position.width, position.height, flipX, flipY);
+	}
+
+	/**
+	 * Constructs a sprite that is filled with one color.
+	 *
+	 * @param position
+	 * @param solidColor
+	 * @param layer
+	 */
+	Sprite(IntRectangle<int32_t> position, SpritePixel solidColor, uint32_t layer):
+		SpriteSource(solidColor), position(position), layer(layer)
+	{
+		//Nothing else to initialize
+	}
+
+	/**
+	 * Constructs a sprite that shows the given run-length encoded bitmap. It can be
+	 * stretched over a position of a different size via sourceRect.
+	 *
+	 * @param position   Must not be larger than the bitmap, unless sourceRect is set.
+	 * @param runLengthBitmap
+	 * @param layer
+	 */
+	Sprite(IntRectangle<int32_t> position, shared_ptr<const RunLengthBitmap> runLengthBitmap, uint32_t layer):
+		SpriteSource(move(runLengthBitmap)), position(position), layer(layer)
+	{
+		//Nothing else to initialize
+	}
+
+	/**
+	 * Constructs a sprite that shows the entire given bitmap.
+	 *
+	 * @param position
+	 * @param bitmap
+	 * @param layer
+	 */
+	Sprite(IntRectangle<int32_t> position, shared_ptr<const SpriteBitmap> bitmap, uint32_t layer):
+		Sprite(position, move(bitmap), 0, 0, layer)
+	{
+		//Nothing else to initialize
+	}
+};
+
+/**
+ * A sprite as the renderer sees it. Only holds what's needed to decide which
+ * sprite is visible where and refers to the pixels by pointer, so the sprite
+ * stacks and the binning pass don't have to touch the std::functions.
+ */
+struct SpriteInstance {
+	IntRectangle<int32_t> position;
+	uint32_t layer = 0;
+
+	/**
+	 * The index of the sprite in the input of the frame, or its slot in a SpriteScene.
+	 * Of two sprites on the same layer, the one with the higher order is on top.
+	 */
+	uint32_t order = 0;
+
+	/**
+	 * True if the sprite hides everything below it: its source is opaque, and it is drawn
+	 * normally at full opacity.
+	 */
+	bool isOpaque = false;
+
+	uint8_t opacity = 0xFF;
+	BlendMode blendMode = BlendMode::Normal;
+	TexelMapping texelMapping;
+	const SpriteSource *source = nullptr;
+
+	SpriteInstance() = default;
+
+	SpriteInstance(IntRectangle<int32_t> position, uint32_t layer, uint32_t order, const SpriteSource *source, uint8_t opacity = 0xFF,
+			BlendMode blendMode = BlendMode::Normal, TexelMapping texelMapping = TexelMapping()):
+		position(position), layer(layer), order(order),
+		isOpaque(source->isOpaque && opacity == 0xFF && blendMode == BlendMode::Normal),
+		opacity(opacity), blendMode(blendMode), texelMapping(texelMapping), source(source)
+	{
+		//Nothing else to initialize
+	}
+
+	SpriteInstance(const Sprite& sprite, uint32_t order):
+		SpriteInstance(sprite.position, sprite.layer, order, &sprite, sprite.opacity, sprite.blendMode, sprite.getTexelMapping())
+	{
+		//Nothing else to initialize
+	}
+
+	/**
+	 * @return The key by which sprites are stacked, bottommost first: the layer, then the order.
+	 *         Unique among the sprites of a frame.
+	 */
+	uint64_t getDepth() const {
+		return ((uint64_t)layer << 32) | order;
+	}
+
+	/**
+	 * Fetches count consecutive pixels of row y of this sprite, starting at column x.
+	 *
+	 * @param x      Relative to the sprite.
+	 * @param y      Relative to the sprite.
+	 * @param count
+	 * @param pixels The buffer to write the pixels to. Must have room for count pixels.
+	 */
+	void getSpan(int x, int y, int count, SpritePixel *pixels) const {
+		source->getSpan(texelMapping, x, y, count, pixels);
+	}
+
+	/**
+	 * @param x Relative to the sprite.
+	 * @param y Relative to the sprite.
+	 * @return The pixel of this sprite at the given coordinates.
+	 */
+	SpritePixel getPixel(int x, int y) const {
+		if (texelMapping.isIdentity && !source->hasFastSpans()) {
+			return source->pixelGetter(x, y);
+		}
+		return source->getPixel(texelMapping, x, y);
+	}
+};
+
+
+}
+
+
+#endif /* SPRITE_HPP_ */
@@ -0,0 +1,165 @@
+/*
+ * SpriteArray.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef SPRITEARRAY_HPP_
+#define SPRITEARRAY_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <cassert>
+
+#include "IntRectangle.hpp"
+#include "Sprite.hpp"
+
+using namespace std;
+using namespace ttlhacker;
+
+namespace mmo2020 {
+
+
+/**
+ * A list of sprites stored as a structure of arrays. The geometry of all sprites
+ * lies in separate, densely packed arrays, while their pixel sources are kept in
+ * a separate table and referred to by handle. Many sprites may share one source.
+ *
+ * The arrays are public so they can be updated in bulk (e.g. moving all sprites).
+ * They must always have the same length, and all source handles must be valid.
+ */
+class SpriteArray {
+public:
+	/**
+	 * Index into the table of sources.
+	 */
+	using SourceHandle = uint32_t;
+
+	vector<int32_t> x;
+	vector<int32_t> y;
+	vector<uint32_t> width;
+	vector<uint32_t> height;
+	vector<uint32_t> layer;
+	vector<uint8_t> opacity;
+	vector<BlendMode> blendMode;
+	vector<SourceHandle> source;
+
+private:
+	vector<SpriteSource> sources;
+
+public:
+	/**
+	 * Adds a source that sprites can take their pixels from.
+	 *
+	 * @param spriteSource
+	 * @return The handle to refer to the source with.
+	 */
+	SourceHandle addSource(SpriteSource spriteSource) {
+		sources.push_back(move(spriteSource));
+		return sources.size() - 1;
+	}
+
+	/**
+	 * @param handle Must be valid.
+	 * @return The source the handle refers to.
+	 */
+	const SpriteSource& getSource(SourceHandle handle) const {
+		assert(handle < sources.size());
+		return sources[handle];
+	}
+
+	/**
+	 * @return The number of sources.
+	 */
+	size_t getSourceCount() const {
+		return sources.size();
+	}
+
+	/**
+	 * Adds a sprite to the end of the arrays.
+	 *
+	 * @param position
+	 * @param spriteLayer
+	 * @param spriteSource    A valid source handle.
+	 * @param spriteOpacity
+	 * @param spriteBlendMode
+	 * @return The index of the new sprite.
+	 */
+	size_t addSprite(IntRectangle<int32_t> position, uint32_t spriteLayer, SourceHandle spriteSource,
+			uint8_t spriteOpacity = 0xFF, BlendMode spriteBlendMode = BlendMode::Normal) {
+		assert(spriteSource < sources.size());
+
+		x.push_back(position.x);
+		y.push_back(position.y);
+		width.push_back(position.width);
+		height.push_back(position.height);
+		layer.push_back(spriteLayer);
+		opacity.push_back(spriteOpacity);
+		blendMode.push_back(spriteBlendMode);
+		source.push_back(spriteSource);
+		return x.size() - 1;
+	}
+
+	/**
+	 * @param index
+	 * @return The position of the sprite with the given index.
+	 */
+	IntRectangle<int32_t> getPosition(size_t index) const {
+		return IntRectangle<int32_t>(x[index], y[index], width[index], height[index]);
+	}
+
+	/**
+	 * @return The number of sprites.
+	 */
+	size_t size() const {
+		assert(y.size() == x.size() && width.size() == x.size() && height.size() == x.size());
+		assert(layer.size() == x.size() && source.size() == x.size());
+		assert(opacity.size() == x.size() && blendMode.size() == x.size());
+		return x.size();
+	}
+
+	/**
+	 * Reserves memory for the given number of sprites.
+	 *
+	 * @param numSprites
+	 */
+	void reserve(size_t numSprites) {
+		x.reserve(numSprites);
+		y.reserve(numSprites);
+		width.reserve(numSprites);
+		height.reserve(numSprites);
+		layer.reserve(numSprites);
+		opacity.reserve(numSprites);
+		blendMode.reserve(numSprites);
+		source.reserve(numSprites);
+	}
+
+	/**
+	 * Removes all sprites, but keeps the sources.
+	 */
+	void clearSprites() {
+		x.clear();
+		y.clear();
+		width.clear();
+		height.clear();
+		layer.clear();
+		opacity.clear();
+		blendMode.clear();
+		source.clear();
+	}
+
+	/**
+	 * Removes all sprites and sources.
+	 */
+	void clear() {
+		clearSprites();
+		sources.clear();
+	}
+};
+
+
+}
+
+
+#endif /* SPRITEARRAY_HPP_ */
@@ -0,0 +1,232 @@
+/*
+ * SpriteBitmap.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef SPRITEBITMAP_HPP_
+#define SPRITEBITMAP_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <functional>
+#include <cassert>
+
+#include "SpritePixel.hpp"
+
+using namespace std;
+
+namespace mmo2020 {
+
+
+static_assert(sizeof(SpritePixel) == sizeof(uint32_t), "SpriteBitmap copies its texels straight into SpritePixels");
+
+/**
+ * An image that sprites can sample their pixels from directly.
+ * The texels are stored row by row as packed RGBA values (R in the lowest byte),
+ * next to a bitmask that says which texels are fully opaque.
+ *
+ * A SpriteBitmap is meant to be shared (via shared_ptr) between all sprites that
+ * use it, so it may also be an atlas containing the images of many sprites.
+ */
+class SpriteBitmap {
+private:
+	using MaskWord = uint64_t;
+	static constexpr uint32_t bitsPerMaskWord = sizeof(MaskWord) * 8;
+
+	uint32_t width, height;
+
+	/**
+	 * Number of MaskWords per row of the opaqueMask.
+	 * Rows are padded to a full MaskWord.
+	 */
+	size_t maskWordsPerRow;
+
+	/**
+	 * width * height packed RGBA values.
+	 */
+	vector<uint32_t> texels;
+
+	/**
+	 * One bit per texel, set if the texel is opaque.
+	 */
+	vector<MaskWord> opaqueMask;
+
+public:
+	/**
+	 * Constructs a fully transparent SpriteBitmap.
+	 *
+	 * @param width
+	 * @param height
+	 */
+	SpriteBitmap(uint32_t width, uint32_t height):
+		width(width), height(height), maskWordsPerRow((width + bitsPerMaskWord - 1) / bitsPerMaskWord)
+	{
+		texels.resize((size_t)width * height, 0);
+		opaqueMask.resize(maskWordsPerRow * height, 0);
+	}
+
+	/**
+	 * Constructs a SpriteBitmap and fills it with the pixels returned by the given function.
+	 *
+	 * @param width
+	 * @param height
+	 * @param pixelGetter Returns the pixel at the given coordinates.
+	 */
+	SpriteBitmap(uint32_t width, uint32_t height, const function<SpritePixel(int x, int y)>& pixelGetter):
+		SpriteBitmap(width, height)
+	{
+		for (uint32_t y = 0; y < height; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				setPixel(x, y, pixelGetter(x, y));
+			}
+		}
+	}
+
+	/**
+	 * @param r
+	 * @param g
+	 * @param b
+	 * @param a
+	 * @return The given color as a packed RGBA value as stored in a SpriteBitmap.
+	 */
+	static constexpr uint32_t packRGBA(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+		return (uint32_t)r | ((uint32_t)g << 8) | ((uint32_t)b << 16) | ((uint32_t)a << 24);
+	}
+
+	uint32_t getWidth() const {
+		return width;
+	}
+
+	uint32_t getHeight() const {
+		return height;
+	}
+
+	/**
+	 * @param x
+	 * @param y
+	 * @param pixel The pixel to store. Pixels that aren't fully opaque clear the texel's bit in the opaque mask.
+	 */
+	void setPixel(uint32_t x, uint32_t y, SpritePixel pixel) {
+		assert(x < width && y < height);
+
+		MaskWord& maskWord = opaqueMask[y * maskWordsPerRow + x / bitsPerMaskWord];
+		const MaskWord bit = (MaskWord)1 << (x % bitsPerMaskWord);
+
+		texels[(size_t)y * width + x] = packRGBA(pixel.r, pixel.g, pixel.b, pixel.a);
+		if (pixel.isOpaque()) {
+			maskWord |= bit;
+		} else {
+			maskWord &= ~bit;
+		}
+	}
+
+	/**
+	 * @param x
+	 * @param y
+	 * @return True if the texel at the given coordinates is fully opaque.
+	 */
+	bool isOpaque(uint32_t x, uint32_t y) const {
+		return (opaqueMask[y * maskWordsPerRow + x / bitsPerMaskWord] >> (x % bitsPerMaskWord)) & 1;
+	}
+
+	/**
+	 * @param x
+	 * @param y
+	 * @param regionWidth
+	 * @param regionHeight
+	 * @return True if every texel of the given region is opaque. The region must lie within the bitmap.
+	 */
+	bool isRegionOpaque(uint32_t x, uint32_t y, uint32_t regionWidth, uint32_t regionHeight) const {
+		assert(x + regionWidth <= width && y + regionHeight <= height);
+
+		for (uint32_t row = y; row < y + regionHeight; row++) {
+			const MaskWord *maskRow = opaqueMask.data() + row * maskWordsPerRow;
+
+			//Check whole MaskWords where possible, single bits at the edges.
+			uint32_t texX = x;
+			const uint32_t end = x + regionWidth;
+			while (texX < end) {
+				if ((texX % bitsPerMaskWord == 0) && (end - texX >= bitsPerMaskWord)) {
+					if (maskRow[texX / bitsPerMaskWord] != ~(MaskWord)0) {
+						return false;
+					}
+					texX += bitsPerMaskWord;
+				} else {
+					if (!isOpaque(texX, row)) {
+						return false;
+					}
+					texX++;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	/**
+	 * @param x
+	 * @param y
+	 * @return The pixel at the given coordinates.
+	 */
+	SpritePixel getPixel(uint32_t x, uint32_t y) const {
+		const uint32_t texel = texels[(size_t)y * width + x];
+		return SpritePixel(texel & 0xFF, (texel >> 8) & 0xFF, (texel >> 16) & 0xFF, texel >> 24);
+	}
+
+	/**
+	 * @param y
+	 * @return A pointer to the first packed RGBA texel of the given row.
+	 */
+	const uint32_t * getRow(uint32_t y) const {
+		return texels.data() + (size_t)y * width;
+	}
+
+	/**
+	 * Fetches count consecutive pixels of row y, starting at column x.
+	 * The span must lie entirely within the bitmap.
+	 *
+	 * @param x
+	 * @param y
+	 * @param count
+	 * @param pixels The buffer to write the pixels to. Must have room for count pixels.
+	 */
+	void getSpan(uint32_t x, uint32_t y, int count, SpritePixel *pixels) const {
+		assert(x + count <= width && y < height);
+
+		//The texels are laid out exactly like SpritePixels.
+		memcpy((void *)pixels, getRow(y) + x, count * sizeof(SpritePixel));
+	}
+
+	/**
+	 * Fetches count pixels of row y, stepping through the row in fixed point.
+	 * Pixel i is taken from column (x + i * step) >> fractionBits. All columns must lie within the bitmap.
+	 *
+	 * @param x            The fixed point column of the first pixel.
+	 * @param step         The fixed point distance between two pixels. May be negative.
+	 * @param fractionBits The number of fractional bits of x and step.
+	 * @param y
+	 * @param count
+	 * @param pixels       The buffer to write the pixels to. Must have room for count pixels.
+	 */
+	void getSteppedSpan(int32_t x, int32_t step, int fractionBits, uint32_t y, int count, SpritePixel *pixels) const {
+		assert(y < height && count > 0);
+		assert(x >= 0 && (uint32_t)(x >> fractionBits) < width);
+		assert(x + (count - 1) * step >= 0 && (uint32_t)((x + (count - 1) * step) >> fractionBits) < width);
+
+		const uint32_t *row = getRow(y);
+		for (int i = 0; i < count; i++) {
+			memcpy((void *)(pixels + i), row + (x >> fractionBits), sizeof(SpritePixel));
+			x += step;
+		}
+	}
+};
+
+
+}
+
+
+#endif /* SPRITEBITMAP_HPP_ */
@@ -0,0 +1,78 @@
+/*
+ * SpritePixel.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef SPRITEPIXEL_HPP_
+#define SPRITEPIXEL_HPP_
+
+#include <cstdint>
+
+using namespace std;
+
+namespace mmo2020 {
+
+
+/**
+ * One pixel of a sprite with 8 bit alpha. The colors are not premultiplied.
+ * Laid out in memory as R, G, B, A, the same as the texels of a SpriteBitmap.
+ */
+struct SpritePixel {
+	uint8_t r, g, b;
+
+	/**
+	 * 0 for fully transparent, 255 for fully opaque.
+	 */
+	uint8_t a;
+
+	/**
+	 * Constructs an opaque SpritePixel with the given color.
+	 *
+	 * @param r
+	 * @param g
+	 * @param b
+	 */
+	SpritePixel(uint8_t r, uint8_t g, uint8_t b):
+		r(r), g(g), b(b), a(0xFF)
+	{
+		//Nothing else to do
+	}
+
+	/**
+	 * Constructs a SpritePixel with the given color and alpha.
+	 *
+	 * @param r
+	 * @param g
+	 * @param b
+	 * @param a
+	 */
+	SpritePixel(uint8_t r, uint8_t g, uint8_t b, uint8_t a):
+		r(r), g(g), b(b), a(a)
+	{
+		//Nothing else to do
+	}
+
+	/**
+	 * Constructs a transparent SpritePixel.
+	 */
+	SpritePixel():
+		r(0), g(0), b(0), a(0)
+	{
+		//Nothing else to do
+	}
+
+	bool isTransparent() const {
+		return a == 0;
+	}
+
+	bool isOpaque() const {
+		return a == 0xFF;
+	}
+};
+
+}
+
+
+#endif /* SPRITEPIXEL_HPP_ */
@@ -9,14 +9,34 @@
 #define SPRITERENDERER_HPP_
 
 #include <cstdint>
+#include <cstring>
 #include <vector>
+#include <deque>
 #include <memory>
 #include <variant>
 #include <functional>
 #include <algorithm>
-
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cassert>
+
+
+#include "Arena.hpp"
+#include "ActiveSet.hpp"
+#include "Background.hpp"
+#include "BackgroundWorker.hpp"
+#include "FrameStats.hpp"
 #include "InlineStorageVector.hpp"
 #include "IntRectangle.hpp"
+#include "LoadBalance.hpp"
+#include "Sprite.hpp"
+#include "SpriteScene.hpp"
+#include "SpriteArray.hpp"
+#include "TaskPool.hpp"
+#include "PixelFormat.hpp"
+#include "Viewport.hpp"
 
 using namespace std;
 using namespace ttlhacker;
@@ -25,79 +45,80 @@ namespace mmo2020 {
 
 
 /**
- * One pixel of a sprite, which may either be fully opaque or
- * fully transparent.
+ * Renders sprites into a framebuffer.
+ *
+ * @tparam numInlineSpritesPerLine The number of sprites that one line can hold before its list spills to the heap.
+ * @tparam PixelFormatPolicy       How to pack rows of pixels into the framebuffer. One of the policies from PixelFormat.hpp,
+ *                                 RowPacker (the default) decides at runtime.
+ * @tparam ActiveSetPolicy         How to keep track of the sprites that are active while rendering a line.
+ *                                 One of the policies from ActiveSet.hpp.
+ * @tparam StatsPolicy             What to record about each frame. One of the policies from FrameStats.hpp,
+ *                                 NoFrameStats (the default) records nothing and costs nothing.
  */
-struct SpritePixel {
-	uint8_t r, g, b;
-	bool isTransparent;
-
+template<size_t numInlineSpritesPerLine = 4, typename PixelFormatPolicy = RowPacker, typename ActiveSetPolicy = VectorActiveSet, typename StatsPolicy = NoFrameStats>
+class SpriteRenderer {
+public:
 	/**
-	 * Constructs a non-transparent SpritePixel with the given color.
+	 * Receives one band of rendered lines from renderStreaming.
 	 *
-	 * @param r
-	 * @param g
-	 * @param b
+	 * @param pixels   The first pixel of the band's first line, in the renderer's pixel format.
+	 * @param pitch    The distance between two lines of the band, in bytes.
+	 * @param firstY   The Y coordinate of the band's first line within the frame.
+	 * @param numLines The number of lines of the band.
 	 */
-	SpritePixel(uint8_t r, uint8_t g, uint8_t b):
-		r(r), g(g), b(b), isTransparent(false)
-	{
-		//Nothing else to do
-	}
+	using BandCallback = function<void(const uint8_t *pixels, size_t pitch, int firstY, int numLines)>;
 
-	/**
-	 * Constructs a transparent SpritePixel.
-	 */
-	SpritePixel():
-		r(0), g(0), b(0), isTransparent(true)
-	{
-		//Nothing else to do
-	}
-};
+private:
 
-/**
- * A sprite to draw to the screen.
- */
-struct Sprite {
 	/**
-	 * Given relative coordinates into the sprite, returns
-	 * the pixel at those coordinates.
+	 * A sprite that begins at some X coordinate of a RasterLine.
+	 * The X coordinate where it ends is taken from the sprite itself.
 	 */
-	using PixelGetter = function<SpritePixel(int x, int y)>;
-
-	IntRectangle<int32_t> position;
-	PixelGetter pixelGetter;
-	uint32_t layer;
+	struct LineEvent {
+		int32_t startX;
 
-	Sprite(IntRectangle<int32_t> position, PixelGetter pixelGetter, uint32_t layer):
-		position(position), pixelGetter(pixelGetter), layer(layer)
-	{
-		//Nothing else to initialize
-	}
-};
+		/**
+		 * Copy of the sprite's depth, so sorting doesn't have to look at the sprite.
+		 */
+		uint64_t depth;
+		const SpriteInstance *sprite;
 
+		bool operator==(const LineEvent& other) const {
+			return (sprite == other.sprite) && (startX == other.startX);
+		}
 
-/**
- * Packs R, G and B values into an opaque pixel represented as an uint32_t.
- */
-using PixelPacker = uint32_t(uint8_t r, uint8_t g, uint8_t b);
+		/**
+		 * The order of the events on a RasterLine: by the X coordinate at which the sprites begin, then by depth.
+		 * Depths are unique, so this is a total order and doesn't depend on the order in which sprites are added.
+		 */
+		static bool isBefore(const LineEvent& a, const LineEvent& b) {
+			return (a.startX != b.startX) ? (a.startX < b.startX) : (a.depth < b.depth);
+		}
+	};
 
-template<size_t numInlineSpritesPerPixel = 4>
-class SpriteRenderer {
-private:
+	using LineEventList = InlineStorageVector<LineEvent, numInlineSpritesPerLine, ArenaAllocator<LineEvent>>;
 
 	/**
-	 * One pixel on a RasterLine.
+	 * The background behind one line that is being rendered, see BackgroundMode.
 	 */
-	struct RasterLinePixel {
+	struct LineBackground {
+		BackgroundMode mode;
+
+		/**
+		 * The opaque background color, for BackgroundMode::Color.
+		 */
+		SpritePixel color;
+
 		/**
-		 * All sprites that begin on this exact pixel.
-		 * Must be a pointer because reference_wrapper can't be default-constructed.
+		 * The packed background pixels behind the line, laid out like the target line. nullptr for BackgroundMode::Color.
 		 */
-		InlineStorageVector<const Sprite *, numInlineSpritesPerPixel> beginningSprites;
+		const uint8_t *pixels;
 
-		inline void clear() {
-			beginningSprites.clear();
+		/**
+		 * @return True for the default black background, which the composited pixels already are on.
+		 */
+		bool isBlack() const {
+			return mode == BackgroundMode::Color && getSpritePixelColorBits(color) == 0;
 		}
 	};
 
@@ -106,155 +127,302 @@ private:
 	 */
 	class RasterLine {
 	private:
-		//using SpriteStack = vector<reference_wrapper<const SpriteOnRasterLine>>;
-		using SpriteStack = vector<const Sprite *>;
-
 		/**
-		 * The pixels on this RasterLine. Each one contains a (custom) vector
-		 * of sprites that begin on that exact pixel.
-		 * This vector always has width elements and is never cleared.
+		 * All sprites on this RasterLine, one event for each. Sorted by the X coordinate
+		 * at which the sprites begin and then by depth, unless isSorted is false.
 		 */
-		vector<RasterLinePixel> pixels;
+		LineEventList events;
+		bool isSorted = true;
 
 		/**
-		 * Inserts all sprites that get activated (have their first pixel) on the given X coordinate
-		 * into the given active sprite stack.
-		 *
-		 * @param spriteStack
-		 * @param x
-		 * @return True if any new sprites have been inserted, false if not.
+		 * What renderRun leaves for the background to fill in.
 		 */
-		void insertAllActivatedSprites(SpriteStack& spriteStack, int x) {
-			RasterLinePixel& rlPx = pixels[x];
+		struct RunResult {
+			/**
+			 * The number of pixels actually rendered.
+			 */
+			int count;
+
+			/**
+			 * False if there are no sprites within the run at all, so its pixels are entirely background.
+			 */
+			bool isCovered;
+
+			/**
+			 * Bounds (inclusive, relative to the run) of the pixels that the background may still show through.
+			 * Within them, the transmittance and unresolvedMask buffers tell how much, with bit 0 of
+			 * unresolvedMask belonging to pixel maskBegin. Empty if everything has been resolved.
+			 */
+			int firstUnresolved, lastUnresolved;
+			int maskBegin;
+		};
 
-			size_t nSpritesToInsert = rlPx.beginningSprites.size();
-			if (nSpritesToInsert == 0) return;
+		/**
+		 * Brings the events into order, if necessary.
+		 */
+		void sortEvents() {
+			if (isSorted) {
+				return;
+			}
 
-			//Sort the sprites to insert in ascending order.
-			auto order = [](const Sprite *a, const Sprite *b) {
-				return a->layer < b->layer;
-			};
-			sort(rlPx.beginningSprites.begin(), rlPx.beginningSprites.end(), order);
+			sort(events.begin(), events.end(), LineEvent::isBefore);
+			isSorted = true;
+		}
 
-			//Turns out inplace_merge is slower than this homegrown monstrosity below.
-			//auto middle = spriteStack.insert(spriteStack.end(), rlPx.beginningSprites.begin(), rlPx.beginningSprites.end());
-			//inplace_merge(spriteStack.begin(), middle, spriteStack.end(), order);
+		/**
+		 * Makes sure that the events are kept in the given arena (or on the heap if nullptr). Only
+		 * switches over while the line is empty; the arena may be a different one every frame.
+		 *
+		 * @param arena
+		 */
+		void useArena(Arena *arena) {
+			const ArenaAllocator<LineEvent> allocator(arena);
+			if (events.empty() && events.get_allocator() != allocator) {
+				events = LineEventList(allocator);
+			}
+		}
 
+		/**
+		 * @param nextEvent The index of the next event that hasn't been processed yet.
+		 * @return The X coordinate at which the next sprites begin, or the end of the line if there are none.
+		 */
+		int getNextActivation(size_t nextEvent) const {
+			return (nextEvent < events.size()) ? events[nextEvent].startX : originX + width;
+		}
 
-			//If the stack is empty, just insert the sorted elements directly and be done.
-			//The loop below can't merge into an empty vector.
-			size_t previousSize = spriteStack.size();
-			if (previousSize == 0) {
-				spriteStack.insert(spriteStack.begin(), rlPx.beginningSprites.begin(), rlPx.beginningSprites.end());
-				return;
+		/**
+		 * Inserts all sprites that get activated (have their first pixel) on the X coordinate
+		 * of the next event into the given set of active sprites.
+		 *
+		 * @param activeSprites
+		 * @param nextEvent     The index of the next event that hasn't been processed yet.
+		 *                      Receives the index of the first event after the inserted ones.
+		 * @return The number of inserted sprites that are known to be opaque.
+		 */
+		size_t insertAllActivatedSprites(ActiveSetPolicy& activeSprites, size_t& nextEvent) {
+			if (nextEvent >= events.size()) return 0;
+
+			//The events are sorted, so all sprites that begin here are next to each other
+			//and already in ascending order.
+			const LineEvent * const firstEvent = events.begin() + nextEvent;
+			const LineEvent *lastEvent = firstEvent;
+			size_t nOpaqueSprites = 0;
+			while (lastEvent != events.end() && lastEvent->startX == firstEvent->startX) {
+				nOpaqueSprites += lastEvent->sprite->isOpaque;
+				lastEvent++;
 			}
 
-			//Append as many nullptrs to the vector as elements that we need to insert.
-			spriteStack.resize(previousSize + nSpritesToInsert, nullptr);
+			nextEvent += lastEvent - firstEvent;
+			activeSprites.insert(firstEvent, lastEvent);
 
-			//Finally merge the new sprites into the spriteStack.
-			auto previousContentIter = spriteStack.begin() + (previousSize - 1);
-			auto writeIter = spriteStack.end();
-			auto spritesToInsertIter = rlPx.beginningSprites.end() - 1;
-
-			bool startOfSpriteStackReached = false;
-			while (true) {
-				writeIter--;
-				const Sprite *spriteToInsert = *spritesToInsertIter;
+			return nOpaqueSprites;
+		}
 
-				//We can insert directly at the write position if there's either no elements of the previous stack content left,
-				//or if we sort before the largest element of the previous stack content that's still left.
-				bool insertHere = startOfSpriteStackReached || (spriteToInsert->layer > (*previousContentIter)->layer);
+		/**
+		 * Finds the topmost active sprite that is known to be fully opaque. Nothing below it
+		 * can be visible, so it owns all pixels that aren't covered by one of the sprites above it.
+		 *
+		 * @param activeSprites
+		 * @param x
+		 * @param occluderEnd   Receives the first X coordinate at which the occluder or one of the sprites above it ends.
+		 * @return The occluder or nullptr if none of the active sprites is known to be opaque.
+		 */
+		const SpriteInstance * findOccluder(const ActiveSetPolicy& activeSprites, int x, int& occluderEnd) const {
+			int end = originX + width;
+			for (auto sprIt = activeSprites.begin(); sprIt != activeSprites.end(); ++sprIt) {
+				const SpriteInstance *spr = *sprIt;
+				const int spriteEnd = spr->position.getLastX() + 1;
+				if (spriteEnd <= x) {
+					continue;
+				}
 
-				if (insertHere) {
-					//Consume one of the new sprites to merge in.
-					*writeIter = spriteToInsert;
-					if (spritesToInsertIter == rlPx.beginningSprites.begin()) {
-						//We just inserted the last sprite and are now done.
-						break;
-					}
-					spritesToInsertIter--;
-				} else {
-					//Move one of the old sprites forward within the vector.
-					*writeIter = *previousContentIter;
-					*previousContentIter = nullptr;
-					if (previousContentIter == spriteStack.begin()) {
-						//No more old sprites left to move over; from now on, just insert everything.
-						startOfSpriteStackReached = true;
-					} else {
-						previousContentIter--;
-					}
+				end = min(end, spriteEnd);
+				if (spr->isOpaque) {
+					occluderEnd = end;
+					return spr;
 				}
 			}
-
+			return nullptr;
 		}
 
 		/**
-		 * Removes all inactive sprites from the given sprite stack. That is,
-		 * it removes all sprites that the given X coordinate is past of already.
-		 *
-		 * @param spriteStack
-		 * @param x
+		 * @param nextEvent The index of the next event that hasn't been processed yet. Must be valid.
+		 * @param occluder
+		 * @return True if all sprites that begin at the X coordinate of the next event lie below the given occluder.
 		 */
-		void removeInactiveSpritesFromSpriteStack(SpriteStack& spriteStack, int x) {
-			spriteStack.erase(
-					remove_if(
-							spriteStack.begin(),
-							spriteStack.end(),
-							[=](const Sprite *sprite) {return x > sprite->position.getLastX();}),
-					spriteStack.end());
+		bool areActivatedSpritesOccluded(size_t nextEvent, const SpriteInstance *occluder) const {
+			const int32_t x = events[nextEvent].startX;
+			for (size_t i = nextEvent; i < events.size() && events[i].startX == x; i++) {
+				if (events[i].depth > occluder->getDepth()) {
+					return false;
+				}
+			}
+			return true;
 		}
 
 		/**
-		 * Renders one pixel of this RasterLine.
-		 * May remove inactive sprites from the spriteStack.
+		 * Renders a run of pixels starting at the given X coordinate. Walks the sprite stack
+		 * from the top, composites each sprite below the ones above it and stops as soon as
+		 * nothing below can shine through anymore at any pixel of the run. The run is cut short
+		 * wherever one of the sprites that had to be looked at ends, so the set of visible
+		 * sprites never changes within a run.
 		 *
-		 * @param spriteStack The current stack of active sprites.
-		 * @param x           The X coordinate of the pixel to render.
-		 * @param y           The Y coordinate of the pixel to render.
-		 * @return            The pixel. May be transparent if there is no opaque sprite at the given coordinates.
+		 * @param activeSprites The currently active sprites. May contain inactive sprites, which are skipped.
+		 * @param x             The X coordinate of the first pixel of the run.
+		 * @param y             The Y coordinate of this RasterLine.
+		 * @param maxCount      The maximum number of pixels in the run. Sprites that begin within this range must be hidden by an opaque sprite.
+		 * @param runPixels     Receives the composited pixels of the run, on a black background. Untouched if the run isn't covered.
+		 * @param spanPixels    Scratch buffer with room for maxCount pixels.
+		 * @param transmittance Scratch buffer with room for maxCount values, see Blending.hpp.
+		 * @param unresolvedMask Scratch buffer with room for getNumMaskWords(maxCount) words, see Blending.hpp.
+		 * @param foundInactive Set to true if activeSprites contains inactive sprites that should be removed.
+		 * @param nSampledSprites Receives the number of sprites whose pixels have been fetched.
+		 * @param counters
+		 * @return              The number of pixels actually rendered and what the background has to fill in, see RunResult.
 		 */
-		SpritePixel renderPixel(SpriteStack& spriteStack, int x, int y) {
-			renderPixelRetry:
-
-			for (auto sprIt = spriteStack.rbegin(); sprIt != spriteStack.rend(); sprIt++) {
-				const Sprite *spr = *sprIt;
-				if (spr->position.getLastX() < x) {
-					//Oops, we found an inactive sprite. Remove it and then retry the renderPixel operation.
-					if (sprIt == spriteStack.rbegin()) {
-						//Avoid iterating through the entire sprite stack if the topmost
-						//sprite is inactive.
-						spriteStack.pop_back();
+		RunResult renderRun(const ActiveSetPolicy& activeSprites, int x, int y, int maxCount, SpritePixel *runPixels, SpritePixel *spanPixels, uint32_t *transmittance,
+				uint64_t *unresolvedMask, bool& foundInactive, int& nSampledSprites, typename StatsPolicy::Counters& counters) {
+			int count = maxCount;
+
+			//Bounds (inclusive, relative to x) of the pixels that sprites further below could still change.
+			int firstUnresolved = 0;
+			int lastUnresolved = count - 1;
+
+			//The pixel (relative to x) of bit 0 of unresolvedMask, which covers the pixels that the last sprite was composited into.
+			int maskBegin = 0;
+
+			//Nothing has been composited into the run yet.
+			bool isEmpty = true;
+
+			for (auto sprIt = activeSprites.begin(); sprIt != activeSprites.end(); ++sprIt) {
+				const SpriteInstance *spr = *sprIt;
+				const IntRectangle<int32_t>& spritePos = spr->position;
+				const int spriteEnd = spritePos.getLastX() + 1;
+				if (spriteEnd <= x) {
+					//Inactive, will be removed after this run.
+					foundInactive = true;
+					continue;
+				}
+
+				//The run must not extend past the end of a sprite that contributes to it.
+				if (spriteEnd - x < count) {
+					count = spriteEnd - x;
+					lastUnresolved = min(lastUnresolved, count - 1);
+					if (firstUnresolved > lastUnresolved) {
+						break;
+					}
+				}
+
+				const int spriteX = x - spritePos.x;
+				const int spriteY = y - spritePos.y;
+				nSampledSprites++;
+
+				if (isEmpty) {
+					//The topmost sprite may write its pixels directly into the run.
+					spr->getSpan(spriteX, spriteY, count, runPixels);
+					isEmpty = false;
+					if (spr->isOpaque) {
+						//It hides everything else, so its pixels are the result.
+						firstUnresolved = lastUnresolved + 1;
+						break;
+					}
+
+					compositeSpanBelowNothing(runPixels, count, spr->opacity, spr->blendMode, transmittance, unresolvedMask);
+				} else {
+					const int spanCount = lastUnresolved - firstUnresolved + 1;
+					if (spr->source->hasFastSpans()) {
+						//Fetch everything between the first and last unresolved pixel at once.
+						spr->getSpan(spriteX + firstUnresolved, spriteY, spanCount, spanPixels);
 					} else {
-						//Something in the middle of the sprite stack is inactive,
-						//remove everything we can since we have to iterate over it anyway.
-						removeInactiveSpritesFromSpriteStack(spriteStack, x);
+						//Only ask for the pixels we actually still need.
+						fill_n(spanPixels, spanCount, SpritePixel());
+						int nFetched = 0;
+						forEachSetBit(unresolvedMask, firstUnresolved - maskBegin, lastUnresolved - maskBegin + 1, [&](int bit) {
+							const int runX = maskBegin + bit;
+							spanPixels[runX - firstUnresolved] = spr->getPixel(spriteX + runX, spriteY);
+							nFetched++;
+						});
+						counters.countSinglePixelFetches(nFetched);
 					}
-					//We need to re-run the entire renderPixel function because our iterators
-					//just got invalidated, breaking this for loop if we would continue.
-					//Please don't hate me for the goto.
-					goto renderPixelRetry;
+					compositeSpanBelow(spanPixels, spanCount, spr->opacity, spr->blendMode, runPixels + firstUnresolved, transmittance + firstUnresolved, unresolvedMask);
+					maskBegin = firstUnresolved;
 				}
 
-				//If the sprite has a pixel for us, return that.
-				const IntRectangle<int32_t>& spritePos = spr->position;
-				SpritePixel pix = spr->pixelGetter(x - spritePos.x, y - spritePos.y);
-				if (!pix.isTransparent) {
-					return pix;
+				if (spr->isOpaque) {
+					//Everything is resolved now, nothing below can be visible.
+					firstUnresolved = lastUnresolved + 1;
+					break;
+				}
+
+				//Shrink the range of unresolved pixels, 64 pixels at a time.
+				const int maskEnd = lastUnresolved - maskBegin + 1;
+				const int firstBit = findFirstSetBit(unresolvedMask, firstUnresolved - maskBegin, maskEnd);
+				if (firstBit == maskEnd) {
+					//Nothing below can be visible.
+					firstUnresolved = lastUnresolved + 1;
+					break;
 				}
+				firstUnresolved = maskBegin + firstBit;
+				lastUnresolved = maskBegin + findLastSetBit(unresolvedMask, firstBit, maskEnd);
+			}
+
+			return RunResult{count, !isEmpty, firstUnresolved, lastUnresolved, maskBegin};
+		}
+
+		/**
+		 * Composites the background below the pixels of a run that it still shows through.
+		 *
+		 * @param run            What renderRun returned for the run.
+		 * @param x              The X coordinate of the first pixel of the run.
+		 * @param runPixels      The composited pixels of the run.
+		 * @param spanPixels     Scratch buffer with room for run.count pixels.
+		 * @param transmittance  The transmittance of the run, as renderRun left it.
+		 * @param unresolvedMask The unresolved pixels of the run, as renderRun left them.
+		 * @param background     The background behind this RasterLine. Must not be black, which needs nothing to be done.
+		 * @param pixelFormat
+		 */
+		void compositeBackgroundBelow(const RunResult& run, int x, SpritePixel *runPixels, SpritePixel *spanPixels,
+				uint32_t *transmittance, uint64_t *unresolvedMask, const LineBackground& background, const PixelFormatPolicy& pixelFormat) const {
+			const int spanCount = run.lastUnresolved - run.firstUnresolved + 1;
+			if (background.mode == BackgroundMode::Color) {
+				fill_n(spanPixels, spanCount, background.color);
+			} else {
+				//Only unpack the background where it is actually visible.
+				fill_n(spanPixels, spanCount, SpritePixel());
+				const size_t bytesPerPixel = pixelFormat.getBytesPerPixel();
+				forEachSetBit(unresolvedMask, run.firstUnresolved - run.maskBegin, run.lastUnresolved - run.maskBegin + 1, [&](int bit) {
+					const int runX = run.maskBegin + bit;
+					spanPixels[runX - run.firstUnresolved] = pixelFormat.unpack(background.pixels + (x + runX - originX) * bytesPerPixel);
+				});
 			}
 
-			return SpritePixel();
+			//The background is opaque, so this resolves every pixel.
+			compositeSpanBelow<BlendMode::Normal>(spanPixels, spanCount, 0xFF, runPixels + run.firstUnresolved, transmittance + run.firstUnresolved, unresolvedMask);
 		}
 
 		int width;
 
+		/**
+		 * The X coordinate of the first pixel of this RasterLine. All X coordinates
+		 * passed to and returned from its methods are absolute.
+		 */
+		int originX;
+
 
 	public:
-		RasterLine(int width):
-			width(width)
+		RasterLine(int width, int originX = 0):
+			width(width), originX(originX)
 		{
-			pixels.resize(width);
+			//Nothing else to initialize
+		}
+
+		/**
+		 * Moves this RasterLine to the given X coordinate. Must be empty.
+		 *
+		 * @param originX The X coordinate of the first pixel of this RasterLine.
+		 */
+		void setOriginX(int originX) {
+			this->originX = originX;
 		}
 
 		/**
@@ -262,151 +430,1934 @@ private:
 		 * The sprite MUST actually have (potentially transparent) pixels on this line.
 		 *
 		 * @param sprite
+		 * @param firstX The first visible X coordinate of the sprite.
+		 * @param arena  If not nullptr, the events are kept in this arena instead of the heap once they
+		 *               don't fit into the line anymore. The line must be cleared before the arena is reset.
+		 */
+		void addSprite(const SpriteInstance *sprite, int32_t firstX, Arena *arena = nullptr) {
+			useArena(arena);
+
+			const LineEvent event{firstX, sprite->getDepth(), sprite};
+			if (!events.empty() && LineEvent::isBefore(event, events.back())) {
+				isSorted = false;
+			}
+			events.push_back(event);
+		}
+
+		/**
+		 * Adds several sprites at once and keeps the events sorted while doing so. Cheaper than
+		 * adding them one by one and sorting again if the line already holds many sprites.
+		 * The sprites MUST actually have (potentially transparent) pixels on this line.
+		 *
+		 * @param first The first event to add. The events must be sorted.
+		 * @param last  The event after the last one to add.
+		 * @param arena See addSprite.
 		 */
-		void addSprite(const Sprite *sprite, int32_t firstX) {
-			pixels[firstX].beginningSprites.put(sprite);
+		void mergeSprites(const LineEvent *first, const LineEvent *last, Arena *arena = nullptr) {
+			if (first == last) return;
+
+			useArena(arena);
+			sortEvents();
+
+			//Make room at the end, then merge from the back so that every event is moved only once.
+			size_t nOldEvents = events.size();
+			for (const LineEvent *event = first; event != last; event++) {
+				events.push_back(*event);
+			}
+
+			size_t writePos = events.size();
+			while (last != first && nOldEvents != 0) {
+				writePos--;
+				if (LineEvent::isBefore(last[-1], events[nOldEvents - 1])) {
+					events[writePos] = events[--nOldEvents];
+				} else {
+					events[writePos] = *--last;
+				}
+			}
+			//Whatever is left of the new events goes to the front. The old ones are already in place.
+			while (last != first) {
+				events[--writePos] = *--last;
+			}
 		}
 
 		/**
-		 * Removes all Sprites from this RasterLine.
+		 * Removes all sprites that end above the given Y coordinate. Keeps the order of the other sprites.
+		 *
+		 * @param y
+		 * @return The number of removed sprites.
 		 */
-		void clear() {
-			for (RasterLinePixel& pixel: pixels) {
-				pixel.clear();
+		size_t removeSpritesEndingAbove(int32_t y) {
+			const LineEvent *newEnd = remove_if(events.begin(), events.end(), [&](const LineEvent& event) {
+				return event.sprite->position.getLastY() < y;
+			});
+
+			const size_t nRemoved = events.end() - newEnd;
+			for (size_t i = 0; i < nRemoved; i++) {
+				events.pop_back();
 			}
+			return nRemoved;
+		}
+
+		/**
+		 * Removes a sprite that has been added to this RasterLine before.
+		 *
+		 * @param sprite
+		 * @param firstX The same X coordinate that was used when adding the sprite.
+		 */
+		void removeSprite(const SpriteInstance *sprite, int32_t firstX) {
+			bool removed = events.remove(LineEvent{firstX, sprite->getDepth(), sprite});
+			assert(removed);
+			(void)removed;
+
+			//The last event took the place of the removed one.
+			isSorted = isSorted && events.size() <= 1;
+		}
+
+		int getWidth() const {
+			return width;
+		}
+
+		/**
+		 * @return The number of sprites on this RasterLine.
+		 */
+		size_t getNumSprites() const {
+			return events.size();
+		}
+
+		/**
+		 * Removes all Sprites from this RasterLine. If the events have spilled to the heap, the line
+		 * keeps that buffer, so a busy line doesn't spill again every time it is filled. Events in an
+		 * arena are let go, as the arena is reset before the line is filled again.
+		 */
+		void clear() {
+			events.clear(events.get_allocator() == ArenaAllocator<LineEvent>(nullptr));
+			isSorted = true;
 		}
 
 		/**
 		 * Renders this RasterLine to the given target line of pixels.
 		 *
-		 * @param targetPixels The target framebuffer line.
-		 * @param y            The Y coordinate of this RasterLine.
-		 * @param pixelPacker
+		 * @param targetLine  The target framebuffer line, beginning at the first pixel of this RasterLine.
+		 * @param y           The Y coordinate of this RasterLine.
+		 * @param pixelFormat
+		 * @param background  The background behind the target line.
+		 * @param arena       Where to allocate scratch memory. Everything allocated in it is freed again when done.
+		 * @param counters    The counters of the calling thread.
+		 */
+		void render(uint8_t *targetLine, int y, const PixelFormatPolicy& pixelFormat, const LineBackground& background, Arena& arena, typename StatsPolicy::Counters& counters) {
+			render(targetLine, y, pixelFormat, background, originX, originX + width, arena, counters);
+		}
+
+		/**
+		 * Renders part of this RasterLine to the given target line of pixels.
+		 * Pixels outside of the given range are left untouched.
+		 *
+		 * @param targetLine  The target framebuffer line, beginning at the first pixel of this RasterLine.
+		 * @param y           The Y coordinate of this RasterLine.
+		 * @param pixelFormat
+		 * @param background  The background behind the target line.
+		 * @param xBegin      The first X coordinate to render.
+		 * @param xEnd        The X coordinate after the last one to render.
+		 * @param arena       Where to allocate scratch memory. Everything allocated in it is freed again when done.
+		 * @param counters    The counters of the calling thread.
 		 */
-		void render(uint32_t *targetPixels, int y, PixelPacker *pixelPacker) {
+		void render(uint8_t *targetLine, int y, const PixelFormatPolicy& pixelFormat, const LineBackground& background, int xBegin, int xEnd,
+				Arena& arena, typename StatsPolicy::Counters& counters) {
+			const Arena::Marker arenaMarker = arena.getMarker();
+			counters.countLine(events.size() > numInlineSpritesPerLine);
+
+			//The currently active sprites, ordered by layer.
+			ActiveSetPolicy activeSprites(arena);
+
+			//The pixels of the line are collected here first and then packed into the framebuffer at once,
+			//except for those that are left to a packed background.
+			SpritePixel *rowPixels = arena.allocate<SpritePixel>(width);
+			uninitialized_default_construct_n(rowPixels, width);
+
+			const size_t bytesPerPixel = pixelFormat.getBytesPerPixel();
+			int packBegin = xBegin;
+			auto packUpTo = [&](int packEnd) {
+				if (packEnd > packBegin) {
+					pixelFormat.packRow(rowPixels + (packBegin - originX), packEnd - packBegin, targetLine + (packBegin - originX) * bytesPerPixel);
+				}
+			};
+
+			//Scratch buffer for the pixels of one run.
+			SpritePixel *spanPixels = arena.allocate<SpritePixel>(width);
+			uninitialized_default_construct_n(spanPixels, width);
+
+			//How much of the sprites further below still shines through each pixel of a run.
+			uint32_t *transmittance = arena.allocate<uint32_t>(width);
+
+			//Which pixels of a run are still unresolved, one bit each.
+			uint64_t *unresolvedMask = arena.allocate<uint64_t>(getNumMaskWords(width));
+
+			sortEvents();
+			size_t nextEvent = 0;
+			int nextActivation = getNextActivation(nextEvent);
+
+			//Upper bound of the number of opaque sprites on the stack.
+			//There's no need to look for an occluder if this is zero.
+			size_t nOpaqueSprites = 0;
+
+			//Everything that begins left of the range might still be visible within it.
+			while (nextActivation < xBegin) {
+				nOpaqueSprites += insertAllActivatedSprites(activeSprites, nextEvent);
+				nextActivation = getNextActivation(nextEvent);
+			}
+			nOpaqueSprites -= activeSprites.removeInactive(xBegin);
+
+			int x = xBegin;
+			while (x < xEnd) {
+				if (x == nextActivation) {
+					nOpaqueSprites += insertAllActivatedSprites(activeSprites, nextEvent);
+					nextActivation = getNextActivation(nextEvent);
+				}
+
+				int runEnd = nextActivation;
+
+				//If there's an opaque sprite, the run doesn't need to end where new sprites begin
+				//as long as they are hidden by it. They still have to be inserted into the stack though.
+				int occluderEnd;
+				const SpriteInstance *occluder = (nOpaqueSprites != 0) ? findOccluder(activeSprites, x, occluderEnd) : nullptr;
+				if (occluder) {
+					while (runEnd < occluderEnd && areActivatedSpritesOccluded(nextEvent, occluder)) {
+						nOpaqueSprites += insertAllActivatedSprites(activeSprites, nextEvent);
+						runEnd = nextActivation = getNextActivation(nextEvent);
+					}
+					runEnd = min(runEnd, occluderEnd);
+				}
+				runEnd = min(runEnd, xEnd);
+
+				bool foundInactive = false;
+				int nSampledSprites = 0;
+				SpritePixel *runPixels = rowPixels + (x - originX);
+				const RunResult run = renderRun(activeSprites, x, y, runEnd - x, runPixels, spanPixels, transmittance, unresolvedMask, foundInactive, nSampledSprites, counters);
+				counters.countRun(run.count, nSampledSprites);
+
+				if (!run.isCovered) {
+					//There are no sprites here at all.
+					if (background.mode == BackgroundMode::Color) {
+						fill_n(runPixels, run.count, background.color);
+					} else {
+						packUpTo(x);
+						if (background.mode == BackgroundMode::Image) {
+							memcpy(targetLine + (x - originX) * bytesPerPixel, background.pixels + (x - originX) * bytesPerPixel, run.count * bytesPerPixel);
+						}
+						packBegin = x + run.count;
+					}
+				} else if (run.firstUnresolved <= run.lastUnresolved && !background.isBlack()) {
+					compositeBackgroundBelow(run, x, runPixels, spanPixels, transmittance, unresolvedMask, background, pixelFormat);
+				}
 
-			//The stack of currently active sprites, sorted so that the topmost sprite
-			//(the one with the largest Z coordinate) is last.
-			SpriteStack activeSpriteStack;
+				x += run.count;
 
-			for (int x = 0; x < width; x++) {
-				insertAllActivatedSprites(activeSpriteStack, x);
-				SpritePixel pix = renderPixel(activeSpriteStack, x, y);
-				if (pix.isTransparent) {
-					pix = SpritePixel(0, 0, 0);
+				if (foundInactive) {
+					nOpaqueSprites -= activeSprites.removeInactive(x);
 				}
-				targetPixels[x] = pixelPacker(pix.r, pix.g, pix.b);
 			}
+
+			packUpTo(xEnd);
+
+			//Deallocating from an arena does nothing, so it's fine that activeSprites is destroyed afterwards.
+			arena.rewind(arenaMarker);
 		}
 	};
 
 	int width, height;
 
 	/**
-	 * All raster lines (horizontal lines of pixels) of the frame to render.
+	 * The raster lines (horizontal lines of pixels) of the frame to render, one band of lines after
+	 * another. There is one band per thread with line ownership, otherwise a single one for all lines.
 	 * These all have the same width.
 	 */
-	vector<RasterLine> rasterLines;
+	vector<vector<RasterLine>> lineBands;
 
 	/**
-	 * The function to use for packing RGB values into uint32_t's when putting
-	 * pixels into the framebuffer.
+	 * The RasterLine of each line of the frame, within lineBands.
 	 */
-	PixelPacker *pixelPacker;
+	vector<RasterLine *> rasterLines;
 
+	/**
+	 * True if each band of lines belongs to a fixed thread of the task pool, see setLineOwnership.
+	 */
+	bool lineOwnership = false;
 
 	/**
-	 * Takes the given Sprites and associates them with the RasterLines they
-	 * might be visible in.
-	 *
-	 * @param sprites
+	 * Packs the rendered rows of pixels into the framebuffer.
 	 */
-	void distributeSpritesToRasterLines(const vector<Sprite>& sprites) {
-		IntRectangle<int32_t> viewport(0, 0, width, height);
+	PixelFormatPolicy pixelFormat;
 
-		constexpr int blockSize = 8;
+	/**
+	 * Id of the SpriteScene whose sprites are currently kept in the RasterLines,
+	 * or 0 if the RasterLines are empty between frames.
+	 */
+	uint64_t boundSceneId = 0;
 
-		//First sort the incoming sprites into horizontal stripes of blockSize lines.
-		//Each of those lines is a "block".
-		const int numBlocks = (height + blockSize - 1) / blockSize;
+	/**
+	 * The version of the bound scene that the RasterLines reflect.
+	 */
+	uint64_t boundSceneVersion = 0;
 
-		struct LineBlock {
-			vector<reference_wrapper<const Sprite>> sprites;
-		};
+	/**
+	 * A sprite of the bound scene as it has been put into the RasterLines.
+	 */
+	struct BinnedSprite {
+		SpriteInstance instance;
 
-		vector<LineBlock> blocks;
-		blocks.resize(numBlocks);
+		/**
+		 * The visible part of the sprite. Empty if the sprite isn't in any RasterLine.
+		 */
+		IntRectangle<int32_t> visibleRect;
+	};
 
-		for (const Sprite& sprite: sprites) {
-			auto visibleRect = viewport.getIntersection(sprite.position);
-			if (visibleRect.isEmpty()) {
-				continue;
-			}
+	/**
+	 * For each slot of the bound scene, the sprite that has been put into the RasterLines.
+	 * A deque because the RasterLines point to the instances, which must not move when the scene grows.
+	 */
+	deque<BinnedSprite> binnedSprites;
 
-			int32_t firstBlock = visibleRect.y / blockSize;
-			int32_t lastBlock = visibleRect.getLastY() / blockSize;
+	/**
+	 * The visible sprites of the current frame if no scene is bound.
+	 */
+	vector<SpriteInstance> frameInstances;
 
-			for (int32_t i = firstBlock; i <= lastBlock; i++) {
-				blocks[i].sprites.push_back(sprite);
-			}
-		}
+	/**
+	 * Scratch buffer for culling a SpriteArray. One entry per sprite, nonzero if it's visible.
+	 */
+	vector<uint8_t> visibilityMask;
 
+	/**
+	 * Scratch buffer for culling a SpriteScene through a camera: the slots of the visible sprites.
+	 */
+	vector<uint32_t> visibleSlots;
 
-		//Then put the sprites from each block into the appropriate RasterLines.
-		//We can do this for each block in parallel.
-#pragma omp parallel for schedule(dynamic)
-		for (int i = 0; i < numBlocks; i++) {
-			IntRectangle<int32_t> blockViewport(0, i * blockSize, width, blockSize);
-			blockViewport = blockViewport.getIntersection(viewport);
+	/**
+	 * Scratch buffers for binning sprites: the sprites of all cells in one flat array,
+	 * the index of each cell's first sprite in it, and the per-chunk counts and offsets.
+	 */
+	vector<const SpriteInstance *> cellSprites;
+	vector<size_t> cellBegins;
+	vector<size_t> chunkCellOffsets;
 
-			for (const Sprite& sprite: blocks[i].sprites) {
-				auto visibleRect = blockViewport.getIntersection(sprite.position);
-				if (visibleRect.isEmpty()) {
-					//No need to waste processor cycles on an invisible sprite
-					continue;
-				}
+	/**
+	 * A rectangle that binSprites splits into a grid of cells.
+	 */
+	struct BinRegion {
+		IntRectangle<int32_t> rect;
+		int cellWidth, cellHeight;
+		int numCellsX;
 
-				int32_t lastY = visibleRect.getLastY();
+		/**
+		 * The index of the region's first cell. The cells of all regions are numbered one region after another.
+		 */
+		size_t firstCell;
+	};
 
-				for (int32_t y = visibleRect.y; y <= lastY; y++) {
-					rasterLines[y].addSprite(&sprite, visibleRect.x);
-				}
-			}
-		}
-	}
+	/**
+	 * The regions that the sprites have been binned into by the last call to binSprites.
+	 */
+	vector<BinRegion> binRegions;
 
-public:
+	/**
+	 * One RasterLine per thread for renderCell, empty between frames. Kept around so that
+	 * rendering many small frames doesn't allocate them again every time.
+	 */
+	vector<RasterLine> cellLines;
 
 	/**
-	 * @param width       The width of the target buffer, in pixels.
-	 * @param height      The height of the target buffer, in pixels.
-	 * @param pixelPacker The function to use for packing RGB values into an uint32_t.
+	 * The bands that renderStreaming renders into before passing them on, kept between frames.
 	 */
-	SpriteRenderer(int width, int height, PixelPacker *pixelPacker):
-		width(width), height(height), pixelPacker(pixelPacker)
-	{
-		//Argument order is not a typo: We want height RasterLines with width pixels each.
-		rasterLines.resize(height, width);
-	}
+	vector<uint8_t> bandBuffers;
 
+	/**
+	 * One arena per thread for everything that only lives for one frame.
+	 * All of them are empty between frames.
+	 */
+	vector<Arena> threadArenas;
 
-	void render(const vector<Sprite>& sprites, uint8_t *framebuffer, size_t pitch) {
-		//First distribute the sprites to the RasterLines that make up the framebuffer
-		distributeSpritesToRasterLines(sprites);
+	/**
+	 * The size of the tiles in tiled mode, or 0 if sprites are rendered line by line.
+	 */
+	int tileWidth = 0, tileHeight = 0;
 
-		//Then render each RasterLine individually and in parallel
-#pragma omp parallel for schedule(dynamic)
-		for (int y = 0; y < height; y++) {
-			uint8_t *framebufferLine = framebuffer + y * pitch;
-			RasterLine& line = rasterLines[y];
-			line.render((uint32_t *)framebufferLine, y, pixelPacker);
+	/**
+	 * What to put behind the sprites, see setBackgroundColor, setBackgroundImage and setBackgroundUntouched.
+	 */
+	BackgroundMode backgroundMode = BackgroundMode::Color;
+	SpritePixel backgroundColor = SpritePixel(0, 0, 0);
+	const uint8_t *backgroundImage = nullptr;
+	size_t backgroundImagePitch = 0;
 
-			//Invariant: All the RasterLines are empty when entering this method.
-			//Therefore we have to empty each line again when we're done with it.
-			line.clear();
-		}
-	}
+	/**
+	 * The framebuffer that renderDirty rendered the bound scene into last time,
+	 * or nullptr if that framebuffer can't be updated incrementally.
+	 */
+	uint8_t *dirtyFramebuffer = nullptr;
+	size_t dirtyFramebufferPitch = 0;
+
+	/**
+	 * The threads that render each frame.
+	 */
+	shared_ptr<TaskPool> taskPool = TaskPool::getDefault();
+
+	/**
+	 * Records what happens while rendering each frame.
+	 */
+	StatsPolicy frameStats;
+
+	/**
+	 * The kinds of tasks that the rendering work of a frame is split into.
+	 */
+	enum class TaskKind {
+		Blocks,
+		Tiles,
+		Lines,
+		DirtyLines,
+		Viewports,
+		StreamedBands
+	};
+
+	/**
+	 * Scratch buffer with the estimated cost of each task of the current frame.
+	 */
+	vector<uint64_t> taskCosts;
 
+	/**
+	 * True to measure the tasks of each frame into loadBalance, and to balance each frame
+	 * by the measurements of the previous one.
+	 */
+	bool measureCosts = false;
+	bool useCostFeedback = false;
+
+	/**
+	 * The measurements of the last frame, the kind of its tasks and the costs
+	 * that had been estimated for them before considering any feedback.
+	 */
+	LoadBalance loadBalance;
+	TaskKind loadBalanceKind = TaskKind::Blocks;
+	vector<uint64_t> lastEstimatedCosts;
+
+	/**
+	 * The thread that renders the frames started by renderAsync, created by the first call.
+	 * Declared last so that it is destroyed first, after finishing the frame it is rendering.
+	 */
+	unique_ptr<BackgroundWorker> backgroundWorker;
+
+	/**
+	 * @return The thread for renderAsync.
+	 */
+	BackgroundWorker& getBackgroundWorker() {
+		if (!backgroundWorker) {
+			backgroundWorker = make_unique<BackgroundWorker>();
+		}
+		return *backgroundWorker;
+	}
+
+	/**
+	 * @param threadIndex The index of the calling thread within the current loop of the task pool.
+	 * @return The arena of the calling thread.
+	 */
+	Arena& getThreadArena(int threadIndex) {
+		return threadArenas[threadIndex];
+	}
+
+	/**
+	 * Makes sure there is an arena for every thread of the task pool.
+	 */
+	void prepareThreadArenas() {
+		const size_t numThreads = taskPool->getNumThreads();
+		if (threadArenas.size() < numThreads) {
+			threadArenas.resize(numThreads);
+		}
+	}
+
+	/**
+	 * Makes sure there is a RasterLine of at least the given width in cellLines for every thread of the task pool.
+	 *
+	 * @param cellWidth
+	 */
+	void prepareCellLines(int cellWidth) {
+		const size_t numThreads = taskPool->getNumThreads();
+		if (cellLines.size() < numThreads || cellLines[0].getWidth() < cellWidth) {
+			const int lineWidth = cellLines.empty() ? cellWidth : max(cellWidth, cellLines[0].getWidth());
+			cellLines.assign(numThreads, RasterLine(lineWidth));
+		}
+	}
+
+	/**
+	 * Frees everything that has been allocated for the current frame.
+	 */
+	void resetThreadArenas() {
+		for (Arena& arena: threadArenas) {
+			arena.reset();
+		}
+	}
+
+	static const SpriteInstance& toInstance(const SpriteInstance& instance) {
+		return instance;
+	}
+
+	static const SpriteInstance& toInstance(const BinnedSprite& binned) {
+		return binned.instance;
+	}
+
+	/**
+	 * Fills frameInstances with the sprites that are at least partially visible.
+	 *
+	 * @param sprites
+	 */
+	void collectVisibleSprites(const vector<Sprite>& sprites) {
+		const IntRectangle<int32_t> viewport(0, 0, width, height);
+
+		frameInstances.clear();
+		for (size_t i = 0; i < sprites.size(); i++) {
+			if (viewport.intersects(sprites[i].position)) {
+				frameInstances.emplace_back(sprites[i], i);
+			}
+		}
+	}
+
+	/**
+	 * Fills frameInstances with the sprites that are at least partially visible.
+	 *
+	 * @param sprites
+	 */
+	void collectVisibleSprites(const SpriteArray& sprites) {
+		const size_t numSprites = sprites.size();
+		const int32_t *xs = sprites.x.data();
+		const int32_t *ys = sprites.y.data();
+		const uint32_t *widths = sprites.width.data();
+		const uint32_t *heights = sprites.height.data();
+
+		//Cull in a separate pass that only reads the coordinates and has no branches,
+		//so the compiler can vectorize it.
+		visibilityMask.resize(numSprites);
+		uint8_t *visible = visibilityMask.data();
+		for (size_t i = 0; i < numSprites; i++) {
+			//In 64 bits, so sprites reaching past the end of the coordinate range don't wrap around.
+			const int64_t endX = (int64_t)xs[i] + widths[i];
+			const int64_t endY = (int64_t)ys[i] + heights[i];
+			visible[i] = (xs[i] < width) & (ys[i] < height) & (endX > 0) & (endY > 0) & (widths[i] != 0) & (heights[i] != 0);
+		}
+
+		frameInstances.clear();
+		for (size_t i = 0; i < numSprites; i++) {
+			if (visible[i]) {
+				frameInstances.emplace_back(sprites.getPosition(i), sprites.layer[i], i, &sprites.getSource(sprites.source[i]), sprites.opacity[i], sprites.blendMode[i]);
+			}
+		}
+	}
+
+	/**
+	 * Fills frameInstances with the sprites of the scene that are at least partially visible
+	 * through the given camera, moved so that the camera is at (0, 0).
+	 *
+	 * @param scene
+	 * @param cameraX
+	 * @param cameraY
+	 */
+	void collectVisibleSprites(const SpriteScene& scene, int32_t cameraX, int32_t cameraY) {
+		visibleSlots.clear();
+		addVisibleSlots(scene, IntRectangle<int32_t>(cameraX, cameraY, width, height));
+
+		//In slot order, like render(const SpriteScene&, ...), no matter how the index happens to return them.
+		sort(visibleSlots.begin(), visibleSlots.end());
+
+		frameInstances.clear();
+		for (uint32_t index: visibleSlots) {
+			frameInstances.emplace_back(*scene.getSpriteInSlot(index), index);
+			IntRectangle<int32_t>& position = frameInstances.back().position;
+			position.x -= cameraX;
+			position.y -= cameraY;
+		}
+	}
+
+	/**
+	 * Fills frameInstances with the sprites of the scene that are at least partially visible
+	 * in any of the given viewports, in the scene's coordinates. Each sprite is only added once.
+	 *
+	 * @param scene
+	 * @param viewports
+	 */
+	void collectVisibleSprites(const SpriteScene& scene, const vector<Viewport>& viewports) {
+		visibleSlots.clear();
+		for (const Viewport& viewport: viewports) {
+			addVisibleSlots(scene, viewport.area);
+		}
+
+		sort(visibleSlots.begin(), visibleSlots.end());
+		visibleSlots.erase(unique(visibleSlots.begin(), visibleSlots.end()), visibleSlots.end());
+
+		frameInstances.clear();
+		for (uint32_t index: visibleSlots) {
+			frameInstances.emplace_back(*scene.getSpriteInSlot(index), index);
+		}
+	}
+
+	/**
+	 * Appends the slots of the sprites of the scene that intersect the given rectangle to visibleSlots.
+	 *
+	 * @param scene
+	 * @param rect
+	 */
+	void addVisibleSlots(const SpriteScene& scene, const IntRectangle<int32_t>& rect) {
+		scene.forEachSpriteIn(rect, [&](uint32_t index, const Sprite&) {
+			visibleSlots.push_back(index);
+		});
+	}
+
+	/**
+	 * Sorts frameInstances the same way the RasterLines sort their events, as if they all began at the given X coordinate.
+	 * Binning keeps the order of the sprites, so afterwards most lines don't have to sort anything themselves.
+	 *
+	 * @param firstX The first X coordinate that is rendered.
+	 */
+	void sortFrameInstances(int32_t firstX) {
+		frameStats.beginPhase(FramePhase::Sort);
+		sort(frameInstances.begin(), frameInstances.end(), [&](const SpriteInstance& a, const SpriteInstance& b) {
+			const int32_t aX = max(a.position.x, firstX);
+			const int32_t bX = max(b.position.x, firstX);
+			return (aX != bX) ? (aX < bX) : (a.getDepth() < b.getDepth());
+		});
+		frameStats.endPhase(FramePhase::Sort);
+	}
+
+	/**
+	 * Sorts the given sprites into a grid of cells, so that cellSprites[cellBegins[i]]
+	 * up to cellSprites[cellBegins[i + 1]] are the sprites that overlap the i-th cell.
+	 * Cells are numbered row by row. The sprites of each cell are in input order.
+	 *
+	 * @param sprites    A random access range of either SpriteInstances or BinnedSprites.
+	 * @param cellWidth
+	 * @param cellHeight
+	 */
+	template<typename SpriteRange>
+	void binSprites(const SpriteRange& sprites, int cellWidth, int cellHeight) {
+		binRegions.clear();
+		addBinRegion(IntRectangle<int32_t>(0, 0, width, height), cellWidth, cellHeight);
+		binSprites(sprites);
+	}
+
+	/**
+	 * Adds a region to be split into cells by the next call to binSprites(sprites).
+	 * An empty region, e.g. the frame of a renderer of width or height 0, has no cells.
+	 *
+	 * @param rect
+	 * @param cellWidth  At least 1, unless the region is empty.
+	 * @param cellHeight At least 1, unless the region is empty.
+	 */
+	void addBinRegion(const IntRectangle<int32_t>& rect, int cellWidth, int cellHeight) {
+		//The size of the frame may be 0, which must not end up as a divisor.
+		cellWidth = max(1, cellWidth);
+		cellHeight = max(1, cellHeight);
+
+		const size_t firstCell = binRegions.empty() ? 0 : binRegions.back().firstCell + getNumCells(binRegions.back());
+		const int numCellsX = (rect.width + cellWidth - 1) / cellWidth;
+		binRegions.push_back(BinRegion{rect, cellWidth, cellHeight, numCellsX, firstCell});
+	}
+
+	static size_t getNumCells(const BinRegion& region) {
+		const int numCellsY = (region.rect.height + region.cellHeight - 1) / region.cellHeight;
+		return (size_t)region.numCellsX * numCellsY;
+	}
+
+	/**
+	 * @param cell
+	 * @return The region that the given cell belongs to.
+	 */
+	const BinRegion& getBinRegion(size_t cell) const {
+		auto region = upper_bound(binRegions.begin(), binRegions.end(), cell, [](size_t cell, const BinRegion& region) {
+			return cell < region.firstCell;
+		});
+		return *(region - 1);
+	}
+
+	/**
+	 * @param cell
+	 * @return The rectangle of the given cell, cut off at the edges of its region.
+	 */
+	IntRectangle<int32_t> getCellRect(size_t cell) const {
+		const BinRegion& region = getBinRegion(cell);
+		const size_t cellInRegion = cell - region.firstCell;
+		const IntRectangle<int32_t> cellRect(
+				region.rect.x + (int32_t)(cellInRegion % region.numCellsX) * region.cellWidth,
+				region.rect.y + (int32_t)(cellInRegion / region.numCellsX) * region.cellHeight,
+				region.cellWidth, region.cellHeight);
+		return cellRect.getIntersection(region.rect);
+	}
+
+	/**
+	 * Like binSprites(sprites, cellWidth, cellHeight), but for the regions in binRegions, which have
+	 * been added by addBinRegion. A sprite that overlaps several regions is binned into each of them.
+	 *
+	 * @param sprites A random access range of either SpriteInstances or BinnedSprites.
+	 */
+	template<typename SpriteRange>
+	void binSprites(const SpriteRange& sprites) {
+		const size_t numCells = binRegions.empty() ? 0 : binRegions.back().firstCell + getNumCells(binRegions.back());
+
+		//This happens in parallel over chunks of the input. Each chunk first counts how many of its
+		//sprites go into each cell, then the counts are turned into offsets into one flat array
+		//and each chunk writes its sprites to its own part of that array. The sprites of each cell
+		//end up in input order, no matter how many threads there are or how they are scheduled.
+		constexpr size_t spritesPerChunk = 4096;
+		const size_t numSprites = sprites.size();
+		const int numChunks = (numSprites + spritesPerChunk - 1) / spritesPerChunk;
+
+		auto forEachCellOfSprite = [&](const SpriteInstance& sprite, auto&& callback) {
+			for (const BinRegion& region: binRegions) {
+				auto visibleRect = region.rect.getIntersection(sprite.position);
+				if (visibleRect.isEmpty()) {
+					continue;
+				}
+
+				const int32_t firstCellX = (visibleRect.x - region.rect.x) / region.cellWidth;
+				const int32_t lastCellX = (visibleRect.getLastX() - region.rect.x) / region.cellWidth;
+				const int32_t firstCellY = (visibleRect.y - region.rect.y) / region.cellHeight;
+				const int32_t lastCellY = (visibleRect.getLastY() - region.rect.y) / region.cellHeight;
+
+				for (int32_t cellY = firstCellY; cellY <= lastCellY; cellY++) {
+					for (int32_t cellX = firstCellX; cellX <= lastCellX; cellX++) {
+						callback(region.firstCell + (size_t)cellY * region.numCellsX + cellX);
+					}
+				}
+			}
+		};
+
+		frameStats.beginPhase(FramePhase::Bin);
+
+		//Number of sprites of each chunk in each cell, indexed by [chunk * numCells + cell].
+		chunkCellOffsets.assign(numChunks * numCells, 0);
+
+		taskPool->parallelFor(0, numChunks, [&](int chunk, int) {
+			size_t *counts = chunkCellOffsets.data() + chunk * numCells;
+			const size_t end = min(numSprites, (chunk + 1) * spritesPerChunk);
+			for (size_t i = chunk * spritesPerChunk; i < end; i++) {
+				forEachCellOfSprite(toInstance(sprites[i]), [&](size_t cell) {
+					counts[cell]++;
+				});
+			}
+		});
+
+		//Prefix sum over all cells and, within each cell, over all chunks in order.
+		//Afterwards each count is the offset at which the chunk begins writing into the cell.
+		cellBegins.resize(numCells + 1);
+		size_t numEntries = 0;
+		for (size_t cell = 0; cell < numCells; cell++) {
+			cellBegins[cell] = numEntries;
+			for (int chunk = 0; chunk < numChunks; chunk++) {
+				size_t& count = chunkCellOffsets[chunk * numCells + cell];
+				const size_t numInChunk = count;
+				count = numEntries;
+				numEntries += numInChunk;
+			}
+		}
+		cellBegins[numCells] = numEntries;
+
+		cellSprites.resize(numEntries);
+
+		taskPool->parallelFor(0, numChunks, [&](int chunk, int) {
+			size_t *offsets = chunkCellOffsets.data() + chunk * numCells;
+			const size_t end = min(numSprites, (chunk + 1) * spritesPerChunk);
+			for (size_t i = chunk * spritesPerChunk; i < end; i++) {
+				const SpriteInstance& sprite = toInstance(sprites[i]);
+				forEachCellOfSprite(sprite, [&](size_t cell) {
+					cellSprites[offsets[cell]++] = &sprite;
+				});
+			}
+		});
+
+		frameStats.endPhase(FramePhase::Bin);
+	}
+
+	/**
+	 * Takes the given sprites and associates them with the RasterLines they
+	 * might be visible in. The sprites must not move in memory until they are
+	 * removed from the RasterLines again.
+	 *
+	 * @param sprites     A random access range of either SpriteInstances or BinnedSprites.
+	 * @param useArenas   True to keep the sprite lists in the thread arenas. The RasterLines must then be
+	 *                    cleared before the end of the frame.
+	 */
+	template<typename SpriteRange>
+	void distributeSpritesToRasterLines(const SpriteRange& sprites, bool useArenas) {
+		//First sort the incoming sprites into horizontal stripes of blockSize lines.
+		//Each of those lines is a "block".
+		binSprites(sprites, width, blockSize);
+
+		//Then put the sprites from each block into the appropriate RasterLines.
+		//We can do this for each block in parallel.
+		//There are no blocks at all if the frame is 0 pixels wide.
+		const int numBlocks = cellBegins.size() - 1;
+		const auto distributeBlock = [&](int block, int threadIndex) {
+			distributeBlockToRasterLines(block, useArenas ? &getThreadArena(threadIndex) : nullptr);
+		};
+		if (lineOwnership) {
+			taskPool->parallelForOwned(0, numBlocks, distributeBlock);
+		} else {
+			taskPool->parallelFor(0, numBlocks, distributeBlock, [&](int block) {
+				return 1 + (cellBegins[block + 1] - cellBegins[block]);
+			});
+		}
+	}
+
+	/**
+	 * (Re)allocates the RasterLines, all empty. With line ownership, each band of lines is allocated
+	 * by the thread that owns it, so that its memory is local to that thread's NUMA node.
+	 */
+	void allocateRasterLines() {
+		const int numBands = lineOwnership ? taskPool->getNumThreads() : 1;
+		const int numBlocks = getNumBlocks();
+
+		lineBands.clear();
+		lineBands.resize(numBands);
+		rasterLines.resize(height);
+
+		//The same split of the blocks as in parallelForOwned.
+		const auto allocateBand = [&](int band, int) {
+			const int firstY = (int)((int64_t)numBlocks * band / numBands) * blockSize;
+			const int endY = min(height, (int)((int64_t)numBlocks * (band + 1) / numBands) * blockSize);
+			if (endY <= firstY) {
+				return;
+			}
+
+			vector<RasterLine>& lines = lineBands[band];
+			lines.assign(endY - firstY, RasterLine(width));
+			for (int y = firstY; y < endY; y++) {
+				rasterLines[y] = &lines[y - firstY];
+			}
+		};
+
+		if (lineOwnership) {
+			taskPool->parallelForOwned(0, numBands, allocateBand);
+		} else {
+			allocateBand(0, 0);
+		}
+	}
+
+	/**
+	 * @param kind
+	 * @return True if the tasks of the given kind are the blocks of the RasterLines and must run
+	 *         on the threads that own them, see setLineOwnership.
+	 */
+	bool areTasksOwned(TaskKind kind) const {
+		return lineOwnership && (kind == TaskKind::Blocks || kind == TaskKind::Lines || kind == TaskKind::DirtyLines);
+	}
+
+	/**
+	 * The number of lines per block when distributing sprites to the RasterLines.
+	 */
+	static constexpr int blockSize = 8;
+
+	int getNumBlocks() const {
+		return (height + blockSize - 1) / blockSize;
+	}
+
+	/**
+	 * The estimated cost of rendering one sprite on one line, relative to the cost of packing one pixel.
+	 */
+	static constexpr uint64_t spriteRowCost = 32;
+
+	/**
+	 * Estimates the cost of the tasks of a frame that has been binned by binSprites: the pixels of each
+	 * cell plus spriteRowCost for each sprite on each row, assuming that every sprite of a cell
+	 * covers all of its rows.
+	 */
+	void estimateCellCosts() {
+		const size_t numCells = cellBegins.size() - 1;
+		taskCosts.resize(numCells);
+		for (const BinRegion& region: binRegions) {
+			const size_t endCell = region.firstCell + getNumCells(region);
+			for (size_t cell = region.firstCell; cell < endCell; cell++) {
+				taskCosts[cell] = (uint64_t)region.cellHeight * (region.cellWidth + spriteRowCost * (cellBegins[cell + 1] - cellBegins[cell]));
+			}
+		}
+	}
+
+	/**
+	 * Runs body(task, threadIndex) for every task of the current frame on the task pool.
+	 * The tasks are balanced by the estimated costs in taskCosts, or by the measurements
+	 * of the last frame if cost feedback is enabled and the last frame had the same tasks.
+	 * Tasks that are owned by threads (see areTasksOwned) always run on their owners instead.
+	 *
+	 * @param kind
+	 * @param body
+	 */
+	template<typename Body>
+	void runTasks(TaskKind kind, const Body& untracedBody) {
+		const int numTasks = taskCosts.size();
+		const auto getCost = [&](int task) {
+			return taskCosts[task];
+		};
+		const auto body = [&](int task, int threadIndex) {
+			frameStats.beginTask(FramePhase::Render, threadIndex);
+			untracedBody(task, threadIndex);
+			frameStats.endTask(FramePhase::Render, threadIndex);
+		};
+
+		const auto runLoop = [&](const auto& loopBody) {
+			if (areTasksOwned(kind)) {
+				taskPool->parallelForOwned(0, numTasks, loopBody);
+			} else {
+				taskPool->parallelFor(0, numTasks, loopBody, getCost);
+			}
+		};
+
+		frameStats.beginPhase(FramePhase::Render);
+		if (!measureCosts) {
+			runLoop(body);
+			frameStats.endPhase(FramePhase::Render);
+			return;
+		}
+
+		//Last frame's time of each task, scaled by how much its estimate changed since then.
+		const bool hasFeedback = useCostFeedback && kind == loadBalanceKind && lastEstimatedCosts.size() == taskCosts.size();
+		lastEstimatedCosts.resize(numTasks);
+		for (int task = 0; task < numTasks; task++) {
+			const uint64_t estimatedCost = taskCosts[task];
+			if (hasFeedback) {
+				taskCosts[task] = loadBalance.measuredNanos[task] * estimatedCost / max<uint64_t>(1, lastEstimatedCosts[task]);
+			}
+			lastEstimatedCosts[task] = estimatedCost;
+		}
+
+		loadBalance.estimatedCosts = taskCosts;
+		loadBalance.measuredNanos.assign(numTasks, 0);
+		loadBalance.threadIndices.assign(numTasks, 0);
+		loadBalanceKind = kind;
+
+		runLoop([&](int task, int threadIndex) {
+			const auto start = chrono::steady_clock::now();
+			body(task, threadIndex);
+			const auto end = chrono::steady_clock::now();
+
+			loadBalance.measuredNanos[task] = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+			loadBalance.threadIndices[task] = threadIndex;
+		});
+
+		loadBalance.threadEstimatedCosts.assign(taskPool->getNumThreads(), 0);
+		loadBalance.threadMeasuredNanos.assign(taskPool->getNumThreads(), 0);
+		for (int task = 0; task < numTasks; task++) {
+			const int threadIndex = loadBalance.threadIndices[task];
+			loadBalance.threadEstimatedCosts[threadIndex] += loadBalance.estimatedCosts[task];
+			loadBalance.threadMeasuredNanos[threadIndex] += loadBalance.measuredNanos[task];
+		}
+		frameStats.endPhase(FramePhase::Render);
+	}
+
+	/**
+	 * Runs body(y, threadIndex) for every line of the frame, see runTasks, with the estimated cost
+	 * of each line in taskCosts. With line ownership, the lines are run block by block, each
+	 * block on the thread that owns it, and taskCosts holds the cost of each block afterwards.
+	 *
+	 * @param kind
+	 * @param body
+	 */
+	template<typename Body>
+	void runLineTasks(TaskKind kind, const Body& body) {
+		if (!lineOwnership) {
+			runTasks(kind, body);
+			return;
+		}
+
+		//No block comes after its first line, so the costs can be summed up in place.
+		const int numBlocks = getNumBlocks();
+		for (int block = 0; block < numBlocks; block++) {
+			const int endY = min(height, (block + 1) * blockSize);
+			uint64_t cost = 0;
+			for (int y = block * blockSize; y < endY; y++) {
+				cost += taskCosts[y];
+			}
+			taskCosts[block] = cost;
+		}
+		taskCosts.resize(numBlocks);
+
+		runTasks(kind, [&](int block, int threadIndex) {
+			const int endY = min(height, (block + 1) * blockSize);
+			for (int y = block * blockSize; y < endY; y++) {
+				body(y, threadIndex);
+			}
+		});
+	}
+
+	/**
+	 * Puts the sprites that binSprites has sorted into the given block into the block's RasterLines.
+	 *
+	 * @param block
+	 * @param arena See RasterLine::addSprite.
+	 */
+	void distributeBlockToRasterLines(int block, Arena *arena) {
+		const IntRectangle<int32_t> viewport(0, 0, width, height);
+		const IntRectangle<int32_t> blockViewport = IntRectangle<int32_t>(0, block * blockSize, width, blockSize).getIntersection(viewport);
+
+		for (size_t j = cellBegins[block]; j < cellBegins[block + 1]; j++) {
+			const SpriteInstance *sprite = cellSprites[j];
+			auto visibleRect = blockViewport.getIntersection(sprite->position);
+			if (visibleRect.isEmpty()) {
+				//No need to waste processor cycles on an invisible sprite
+				continue;
+			}
+
+			int32_t lastY = visibleRect.getLastY();
+
+			for (int32_t y = visibleRect.y; y <= lastY; y++) {
+				rasterLines[y]->addSprite(sprite, visibleRect.x, arena);
+			}
+		}
+	}
+
+	/**
+	 * Renders frameInstances line by line. Distributing the sprites to the RasterLines and rendering
+	 * them happen in the same task per block, so a block's lines are rendered while their sprite lists
+	 * are still in the cache, and no thread has to wait for all blocks to be distributed.
+	 *
+	 * @param framebuffer
+	 * @param pitch
+	 */
+	void distributeAndRenderFrameInstances(uint8_t *framebuffer, size_t pitch) {
+		dirtyFramebuffer = nullptr;
+
+		binSprites(frameInstances, width, blockSize);
+		estimateCellCosts();
+
+		runTasks(TaskKind::Blocks, [&](int block, int threadIndex) {
+			Arena& arena = getThreadArena(threadIndex);
+			const Arena::Marker blockMarker = arena.getMarker();
+
+			distributeBlockToRasterLines(block, &arena);
+
+			const int lastY = min(height, (block + 1) * blockSize);
+			for (int y = block * blockSize; y < lastY; y++) {
+				RasterLine& line = *rasterLines[y];
+				uint8_t *targetLine = framebuffer + y * pitch;
+				line.render(targetLine, y, pixelFormat, getLineBackground(targetLine, 0, y), arena, frameStats.getCounters(threadIndex));
+
+				//Invariant: Unless a scene is bound, all the RasterLines are empty when entering
+				//a render method. Therefore we have to empty each line again when we're done with it.
+				line.clear();
+			}
+
+			arena.rewind(blockMarker);
+		});
+
+		resetThreadArenas();
+	}
+
+	/**
+	 * Renders one cell that binSprites has sorted sprites into, row by row, through a RasterLine
+	 * that is only as wide as the cell, so the sprite lists and the rendered pixels stay in the
+	 * cache until the cell is done.
+	 * The RasterLine is carried from one row to the next: only the sprites whose top
+	 * or bottom edge is on a row are added or removed, and the events stay sorted,
+	 * so the work per row depends on how much changes rather than on the number of sprites.
+	 *
+	 * @param cell
+	 * @param target      The framebuffer pixel of the cell's top left corner.
+	 * @param pitch
+	 * @param cellLine    An empty RasterLine at least as wide as the cell. Empty again afterwards.
+	 * @param threadIndex
+	 */
+	void renderCell(size_t cell, uint8_t *target, size_t pitch, RasterLine& cellLine, int threadIndex) {
+		Arena& arena = getThreadArena(threadIndex);
+
+		const IntRectangle<int32_t> cellRect = getCellRect(cell);
+		const IntRectangle<int32_t> regionRect = getBinRegion(cell).rect;
+		cellLine.setOriginX(cellRect.x);
+
+		const Arena::Marker cellMarker = arena.getMarker();
+		const size_t nSprites = cellBegins[cell + 1] - cellBegins[cell];
+		const SpriteInstance * const *cellSpriteList = cellSprites.data() + cellBegins[cell];
+
+		//Events of all sprites of the cell in the order in which they appear, then in the order of the RasterLine,
+		//so the sprites that appear on each row are next to each other and already sorted.
+		LineEvent *appearing = arena.allocate<LineEvent>(nSprites);
+		for (size_t i = 0; i < nSprites; i++) {
+			const SpriteInstance *sprite = cellSpriteList[i];
+			appearing[i] = LineEvent{max(sprite->position.x, cellRect.x), sprite->getDepth(), sprite};
+		}
+		sort(appearing, appearing + nSprites, [&](const LineEvent& a, const LineEvent& b) {
+			const int32_t aFirstY = max(a.sprite->position.y, cellRect.y);
+			const int32_t bFirstY = max(b.sprite->position.y, cellRect.y);
+			return (aFirstY != bFirstY) ? (aFirstY < bFirstY) : LineEvent::isBefore(a, b);
+		});
+
+		//The last rows of all sprites of the cell, in ascending order.
+		int32_t *lastRows = arena.allocate<int32_t>(nSprites);
+		for (size_t i = 0; i < nSprites; i++) {
+			lastRows[i] = cellSpriteList[i]->position.getLastY();
+		}
+		sort(lastRows, lastRows + nSprites);
+
+		size_t nextAppearing = 0;
+		size_t nextLastRow = 0;
+
+		const int32_t lastY = cellRect.getLastY();
+		for (int32_t y = cellRect.y; y <= lastY; y++) {
+			//Drop the sprites that ended on the previous row, if there are any.
+			if (nextLastRow < nSprites && lastRows[nextLastRow] < y) {
+				while (nextLastRow < nSprites && lastRows[nextLastRow] < y) {
+					nextLastRow++;
+				}
+				cellLine.removeSpritesEndingAbove(y);
+			}
+
+			//Add the sprites that begin on this row.
+			const size_t firstAppearing = nextAppearing;
+			while (nextAppearing < nSprites && appearing[nextAppearing].sprite->position.y <= y) {
+				nextAppearing++;
+			}
+			cellLine.mergeSprites(appearing + firstAppearing, appearing + nextAppearing, &arena);
+
+			uint8_t *targetLine = target + (y - cellRect.y) * pitch;
+			const LineBackground background = getLineBackground(targetLine, cellRect.x - regionRect.x, y - regionRect.y);
+			cellLine.render(targetLine, y, pixelFormat, background, cellRect.x, cellRect.getLastX() + 1, arena, frameStats.getCounters(threadIndex));
+		}
+
+		cellLine.clear();
+		arena.rewind(cellMarker);
+	}
+
+	/**
+	 * @param targetLine The first pixel of a line that is about to be rendered.
+	 * @param frameX     The X coordinate of that pixel within the frame (or viewport) that it belongs to.
+	 * @param frameY     The Y coordinate of that pixel within the frame (or viewport).
+	 * @return The background behind the line.
+	 */
+	LineBackground getLineBackground(uint8_t *targetLine, int32_t frameX, int32_t frameY) const {
+		switch (backgroundMode) {
+			case BackgroundMode::Image:
+				return LineBackground{backgroundMode, backgroundColor, backgroundImage + frameY * backgroundImagePitch + frameX * pixelFormat.getBytesPerPixel()};
+			case BackgroundMode::Untouched:
+				return LineBackground{backgroundMode, backgroundColor, targetLine};
+			default:
+				return LineBackground{backgroundMode, backgroundColor, nullptr};
+		}
+	}
+
+	/**
+	 * Renders frameInstances tile by tile, see renderCell. Each tile is rendered by one thread
+	 * without touching the rest of the frame. The RasterLines of this renderer aren't used.
+	 *
+	 * @param framebuffer
+	 * @param pitch
+	 */
+	void renderTiles(uint8_t *framebuffer, size_t pitch) {
+		dirtyFramebuffer = nullptr;
+
+		binSprites(frameInstances, tileWidth, tileHeight);
+
+		prepareCellLines(tileWidth);
+
+		estimateCellCosts();
+		runTasks(TaskKind::Tiles, [&](int tile, int threadIndex) {
+			const IntRectangle<int32_t> tileRect = getCellRect(tile);
+			uint8_t *target = framebuffer + tileRect.y * pitch + tileRect.x * pixelFormat.getBytesPerPixel();
+			renderCell(tile, target, pitch, cellLines[threadIndex], threadIndex);
+		});
+
+		resetThreadArenas();
+	}
+
+	/**
+	 * Renders frameInstances into several viewports, see render(const SpriteScene&, const vector<Viewport>&).
+	 * The sprites are binned into the cells of all viewports at once, and all cells are rendered
+	 * in one loop of the task pool. The RasterLines of this renderer aren't used.
+	 *
+	 * @param viewports
+	 */
+	void renderViewports(const vector<Viewport>& viewports) {
+		dirtyFramebuffer = nullptr;
+		if (viewports.empty()) {
+			return;
+		}
+
+		prepareThreadArenas();
+
+		int32_t firstX = viewports[0].area.x;
+		for (const Viewport& viewport: viewports) {
+			firstX = min(firstX, viewport.area.x);
+		}
+		sortFrameInstances(firstX);
+
+		//Tiles in tiled mode, otherwise bands of full lines of each viewport.
+		uint32_t maxCellWidth = tileWidth;
+		binRegions.clear();
+		for (const Viewport& viewport: viewports) {
+			if (tileWidth != 0) {
+				addBinRegion(viewport.area, tileWidth, tileHeight);
+			} else {
+				addBinRegion(viewport.area, max<uint32_t>(1, viewport.area.width), blockSize);
+				maxCellWidth = max(maxCellWidth, viewport.area.width);
+			}
+		}
+		binSprites(frameInstances);
+
+		prepareCellLines(maxCellWidth);
+
+		estimateCellCosts();
+		runTasks(TaskKind::Viewports, [&](int cell, int threadIndex) {
+			const BinRegion& region = getBinRegion(cell);
+			const Viewport& viewport = viewports[&region - binRegions.data()];
+
+			const IntRectangle<int32_t> cellRect = getCellRect(cell);
+			uint8_t *target = viewport.framebuffer + (cellRect.y - viewport.area.y) * viewport.pitch
+					+ (cellRect.x - viewport.area.x) * pixelFormat.getBytesPerPixel();
+			renderCell(cell, target, viewport.pitch, cellLines[threadIndex], threadIndex);
+		});
+
+		resetThreadArenas();
+	}
+
+	/**
+	 * Renders frameInstances band by band into a ring of band buffers and passes each band on
+	 * to the callback as soon as it and all bands above it are done, see renderStreaming.
+	 *
+	 * @param bandHeight
+	 * @param callback
+	 */
+	void streamFrameInstances(int bandHeight, const BandCallback& callback) {
+		assert(bandHeight > 0);
+		assert(backgroundMode != BackgroundMode::Untouched);
+		dirtyFramebuffer = nullptr;
+
+		prepareThreadArenas();
+		sortFrameInstances(0);
+		binSprites(frameInstances, width, bandHeight);
+		prepareCellLines(width);
+
+		//Enough bands that each thread can render the next one while the callback is busy with one
+		//of the others. Only the frame's width and this number of bands are ever in memory.
+		const int numBands = cellBegins.size() - 1;
+		const int numSlots = 2 * taskPool->getNumThreads();
+		const size_t bandPitch = width * pixelFormat.getBytesPerPixel();
+		const size_t slotSize = bandPitch * bandHeight;
+		bandBuffers.resize(slotSize * numSlots);
+
+		//Bands that are done but haven't been passed on yet, and the first one that hasn't been passed
+		//on. The band in a slot may only be overwritten after it has been passed on.
+		mutex bandMutex;
+		condition_variable bandPassedOn;
+		vector<uint8_t> isBandDone(numBands, false);
+		int nextBandToPassOn = 0;
+		bool isPassingOn = false;
+
+		estimateCellCosts();
+		runTasks(TaskKind::StreamedBands, [&](int band, int threadIndex) {
+			//Each thread runs its bands from top to bottom and only ever waits for bands further up,
+			//so the topmost band that isn't done yet never waits, and this can't deadlock.
+			{
+				unique_lock<mutex> lock(bandMutex);
+				bandPassedOn.wait(lock, [&]() {
+					return nextBandToPassOn > band - numSlots;
+				});
+			}
+
+			uint8_t *slot = bandBuffers.data() + (band % numSlots) * slotSize;
+			renderCell(band, slot, bandPitch, cellLines[threadIndex], threadIndex);
+
+			//Whichever thread finishes the next band in order passes it on, and all following bands
+			//that are done by then. The callback is called without holding the lock, so the other
+			//threads can keep finishing bands meanwhile.
+			unique_lock<mutex> lock(bandMutex);
+			isBandDone[band] = true;
+			if (isPassingOn) {
+				return;
+			}
+			isPassingOn = true;
+			while (nextBandToPassOn < numBands && isBandDone[nextBandToPassOn]) {
+				const int bandToPassOn = nextBandToPassOn;
+				lock.unlock();
+
+				const IntRectangle<int32_t> bandRect = getCellRect(bandToPassOn);
+				callback(bandBuffers.data() + (bandToPassOn % numSlots) * slotSize, bandPitch, bandRect.y, bandRect.height);
+
+				lock.lock();
+				nextBandToPassOn++;
+				bandPassedOn.notify_all();
+			}
+			isPassingOn = false;
+		});
+
+		resetThreadArenas();
+	}
+
+	/**
+	 * Renders all RasterLines into the framebuffer.
+	 *
+	 * @param framebuffer
+	 * @param pitch
+	 */
+	void renderRasterLines(uint8_t *framebuffer, size_t pitch) {
+		dirtyFramebuffer = nullptr;
+
+		taskCosts.resize(height);
+		for (int y = 0; y < height; y++) {
+			taskCosts[y] = width + spriteRowCost * rasterLines[y]->getNumSprites();
+		}
+
+		//Render each RasterLine individually and in parallel, batching cheap lines together.
+		runLineTasks(TaskKind::Lines, [&](int y, int threadIndex) {
+			uint8_t *targetLine = framebuffer + y * pitch;
+			rasterLines[y]->render(targetLine, y, pixelFormat, getLineBackground(targetLine, 0, y), getThreadArena(threadIndex), frameStats.getCounters(threadIndex));
+		});
+
+		resetThreadArenas();
+	}
+
+	/**
+	 * Renders frameInstances, either tile by tile or through the RasterLines.
+	 *
+	 * @param framebuffer
+	 * @param pitch
+	 */
+	void renderFrameInstances(uint8_t *framebuffer, size_t pitch) {
+		prepareThreadArenas();
+		sortFrameInstances(0);
+
+		if (tileWidth != 0) {
+			renderTiles(framebuffer, pitch);
+			return;
+		}
+
+		distributeAndRenderFrameInstances(framebuffer, pitch);
+	}
+
+	/**
+	 * Removes all sprites of the bound scene from the RasterLines, if there is one.
+	 */
+	void unbindScene() {
+		if (boundSceneId == 0) {
+			return;
+		}
+
+		frameStats.beginPhase(FramePhase::Clear);
+		if (lineOwnership) {
+			taskPool->parallelForOwned(0, getNumBlocks(), [&](int block, int) {
+				const int endY = min(height, (block + 1) * blockSize);
+				for (int y = block * blockSize; y < endY; y++) {
+					rasterLines[y]->clear();
+				}
+			});
+		} else {
+			taskPool->parallelFor(0, height, [&](int y, int) {
+				rasterLines[y]->clear();
+			});
+		}
+		frameStats.endPhase(FramePhase::Clear);
+
+		boundSceneId = 0;
+		binnedSprites.clear();
+		dirtyFramebuffer = nullptr;
+	}
+
+	/**
+	 * Adds a sprite to all RasterLines within the given rectangle.
+	 *
+	 * @param sprite
+	 * @param visibleRect The visible part of the sprite.
+	 */
+	void addSpriteToRasterLines(const SpriteInstance *sprite, const IntRectangle<int32_t>& visibleRect) {
+		if (visibleRect.isEmpty()) {
+			return;
+		}
+
+		int32_t lastY = visibleRect.getLastY();
+		for (int32_t y = visibleRect.y; y <= lastY; y++) {
+			rasterLines[y]->addSprite(sprite, visibleRect.x);
+		}
+	}
+
+	/**
+	 * Removes a sprite from all RasterLines within the given rectangle.
+	 *
+	 * @param sprite
+	 * @param visibleRect The same rectangle that was used when adding the sprite.
+	 */
+	void removeSpriteFromRasterLines(const SpriteInstance *sprite, const IntRectangle<int32_t>& visibleRect) {
+		if (visibleRect.isEmpty()) {
+			return;
+		}
+
+		int32_t lastY = visibleRect.getLastY();
+		for (int32_t y = visibleRect.y; y <= lastY; y++) {
+			rasterLines[y]->removeSprite(sprite, visibleRect.x);
+		}
+	}
+
+	/**
+	 * Brings the RasterLines up to date with the given scene. Only applies the changes
+	 * since the last frame if the scene is already bound and not too much has changed,
+	 * otherwise redistributes all of its sprites.
+	 *
+	 * @param scene
+	 * @param damagedRects If not nullptr, receives the old and new visible rectangles of all changed sprites.
+	 * @return True if only the changes have been applied, false if everything has been redistributed.
+	 */
+	bool syncScene(const SpriteScene& scene, vector<IntRectangle<int32_t>> *damagedRects = nullptr) {
+		IntRectangle<int32_t> viewport(0, 0, width, height);
+
+		bool canApplyChanges = (boundSceneId == scene.getId()) && scene.hasChangesSince(boundSceneVersion);
+		if (canApplyChanges) {
+			//Updating a sprite costs about twice as much as distributing it from scratch.
+			size_t numChanges = scene.getChangesEnd() - scene.getChangesSince(boundSceneVersion);
+			canApplyChanges = numChanges <= scene.size() / 2;
+		}
+
+		if (canApplyChanges) {
+			binnedSprites.resize(scene.getSlotCount());
+
+			for (auto it = scene.getChangesSince(boundSceneVersion); it != scene.getChangesEnd(); it++) {
+				BinnedSprite& binned = binnedSprites[*it];
+				removeSpriteFromRasterLines(&binned.instance, binned.visibleRect);
+				if (damagedRects && !binned.visibleRect.isEmpty()) {
+					damagedRects->push_back(binned.visibleRect);
+				}
+
+				const Sprite *sprite = scene.getSpriteInSlot(*it);
+				binned.instance = sprite ? SpriteInstance(*sprite, *it) : SpriteInstance();
+				binned.visibleRect = viewport.getIntersection(binned.instance.position);
+				addSpriteToRasterLines(&binned.instance, binned.visibleRect);
+				if (damagedRects && !binned.visibleRect.isEmpty()) {
+					damagedRects->push_back(binned.visibleRect);
+				}
+			}
+		} else {
+			unbindScene();
+			binnedSprites.resize(scene.getSlotCount());
+
+			for (uint32_t index = 0; index < scene.getSlotCount(); index++) {
+				if (const Sprite *sprite = scene.getSpriteInSlot(index)) {
+					BinnedSprite& binned = binnedSprites[index];
+					binned.instance = SpriteInstance(*sprite, index);
+					binned.visibleRect = viewport.getIntersection(sprite->position);
+				}
+			}
+
+			//Free slots have empty instances, which are skipped.
+			distributeSpritesToRasterLines(binnedSprites, false);
+		}
+
+		boundSceneId = scene.getId();
+		boundSceneVersion = scene.getVersion();
+
+		return canApplyChanges;
+	}
+
+	/**
+	 * Replaces overlapping rectangles of the given list by their bounding boxes
+	 * until no two rectangles overlap anymore.
+	 *
+	 * @param rects
+	 */
+	static void mergeOverlappingRects(vector<IntRectangle<int32_t>>& rects) {
+		bool mergedAny = true;
+		while (mergedAny) {
+			mergedAny = false;
+			for (size_t i = 0; i < rects.size(); i++) {
+				for (size_t j = i + 1; j < rects.size(); j++) {
+					if (rects[i].intersects(rects[j])) {
+						rects[i] = rects[i].getBoundingBox(rects[j]);
+						rects[j] = rects.back();
+						rects.pop_back();
+						j = i;
+						mergedAny = true;
+					}
+				}
+			}
+		}
+	}
+
+public:
+
+	/**
+	 * Only available with a pixel format policy that doesn't need any parameters,
+	 * i.e. not with RowPacker.
+	 *
+	 * @param width  The width of the target buffer, in pixels.
+	 * @param height The height of the target buffer, in pixels.
+	 */
+	SpriteRenderer(int width, int height):
+		width(width), height(height)
+	{
+		allocateRasterLines();
+	}
+
+	/**
+	 * Only available with the RowPacker pixel format policy.
+	 *
+	 * @param width       The width of the target buffer, in pixels.
+	 * @param height      The height of the target buffer, in pixels.
+	 * @param pixelPacker The function to use for packing RGB values into an uint32_t.
+	 */
+	SpriteRenderer(int width, int height, PixelPacker *pixelPacker):
+		width(width), height(height), pixelFormat(pixelPacker)
+	{
+		allocateRasterLines();
+	}
+
+	/**
+	 * Only available with the RowPacker pixel format policy.
+	 *
+	 * @param width       The width of the target buffer, in pixels.
+	 * @param height      The height of the target buffer, in pixels.
+	 * @param pixelFormat The format of the target buffer. Must not be PixelFormat::Custom.
+	 */
+	SpriteRenderer(int width, int height, PixelFormat pixelFormat):
+		width(width), height(height), pixelFormat(pixelFormat)
+	{
+		allocateRasterLines();
+	}
+
+
+	/**
+	 * Switches between rendering line by line and rendering tile by tile. In tiled mode, sprites
+	 * are sorted into tiles, and each tile is rendered by one thread without touching the rest
+	 * of the frame. This works better for wide framebuffers with many small sprites.
+	 * Doesn't affect render(scene, framebuffer, pitch) and renderDirty, which always render line by line.
+	 *
+	 * @param tileWidth  The width of the tiles in pixels, or 0 to render line by line.
+	 * @param tileHeight The height of the tiles in pixels, or 0 to render line by line.
+	 */
+	void setTileSize(int tileWidth, int tileHeight) {
+		assert(tileWidth >= 0 && tileHeight >= 0);
+		assert((tileWidth == 0) == (tileHeight == 0));
+		this->tileWidth = tileWidth;
+		this->tileHeight = tileHeight;
+	}
+
+	/**
+	 * Switches to rendering in bands of full lines, a shortcut for setTileSize(width, bandHeight).
+	 * Each band is rendered by one thread from top to bottom, and each line reuses the sorted
+	 * sprites of the line above, so tall sprites cost little after their first line.
+	 *
+	 * @param bandHeight The number of lines per band, or 0 to render line by line.
+	 */
+	void setBandHeight(int bandHeight) {
+		setTileSize((bandHeight != 0) ? max(1, width) : 0, bandHeight);
+	}
+
+	/**
+	 * Puts a solid color behind all sprites. Pixels without any sprites are filled with it, all others
+	 * are blended over it. The default is black, which costs nothing since the sprites are composited
+	 * on black anyway. This is much cheaper than a background sprite covering the whole frame, which
+	 * every run of pixels would have to look at.
+	 *
+	 * @param color The background color. Its alpha is ignored.
+	 */
+	void setBackgroundColor(SpritePixel color) {
+		backgroundMode = BackgroundMode::Color;
+		backgroundColor = SpritePixel(color.r, color.g, color.b);
+		dirtyFramebuffer = nullptr;
+	}
+
+	/**
+	 * Puts an image behind all sprites, e.g. a static backdrop, which is already packed in the pixel
+	 * format of the framebuffer. Pixels without any sprites are copied from it as they are, the pixels
+	 * that the sprites only partly cover are blended over it. Pixel (x, y) of the image lies behind
+	 * pixel (x, y) of the framebuffer, or of each viewport's framebuffer.
+	 *
+	 * Only available with pixel formats that can be unpacked, i.e. not with PixelFormat::Custom.
+	 *
+	 * @param image The first pixel of the image. Must be at least as large as the framebuffers and
+	 *              stay valid and unchanged while rendering.
+	 * @param pitch The distance between two lines of the image, in bytes.
+	 */
+	void setBackgroundImage(const uint8_t *image, size_t pitch) {
+		assert(image && pixelFormat.canUnpack());
+		backgroundMode = BackgroundMode::Image;
+		backgroundImage = image;
+		backgroundImagePitch = pitch;
+		dirtyFramebuffer = nullptr;
+	}
+
+	/**
+	 * Leaves the framebuffer as it is behind the sprites: pixels without any sprites aren't written
+	 * at all, and the pixels that the sprites only partly cover are blended over what the framebuffer
+	 * already contains, e.g. a frame drawn by something else. With renderDirty, pixels that sprites
+	 * have left keep whatever they were before as well.
+	 *
+	 * Only available with pixel formats that can be unpacked, i.e. not with PixelFormat::Custom.
+	 */
+	void setBackgroundUntouched() {
+		assert(pixelFormat.canUnpack());
+		backgroundMode = BackgroundMode::Untouched;
+		dirtyFramebuffer = nullptr;
+	}
+
+	BackgroundMode getBackgroundMode() const {
+		return backgroundMode;
+	}
+
+	/**
+	 * Makes this renderer use the given threads, e.g. a pool that is shared with other parts of
+	 * a program or one with pinned threads. A pool of one thread renders everything on the thread
+	 * that calls the render methods. By default, all renderers share TaskPool::getDefault().
+	 * Must not be called while a frame is being rendered.
+	 *
+	 * @param taskPool
+	 */
+	void setTaskPool(shared_ptr<TaskPool> taskPool) {
+		assert(taskPool);
+		if (lineOwnership) {
+			//The bands belong to the threads of the old pool.
+			unbindScene();
+			this->taskPool = move(taskPool);
+			allocateRasterLines();
+		} else {
+			this->taskPool = move(taskPool);
+		}
+	}
+
+	/**
+	 * @return The threads that render the frames of this renderer.
+	 */
+	const shared_ptr<TaskPool>& getTaskPool() const {
+		return taskPool;
+	}
+
+	/**
+	 * Binds each band of lines to a fixed thread of the task pool, for machines with several NUMA
+	 * nodes. The frame's blocks of lines are split into one contiguous band per thread, the same
+	 * split as TaskPool::parallelForOwned, and the RasterLines of each band are allocated by its
+	 * thread. Distributing sprites to them, rendering and clearing them then always happens on
+	 * that thread, without any stealing, so neither the RasterLines nor the rows of the framebuffer
+	 * cross between the nodes. This gives up balancing the load between the threads, so it only pays
+	 * off if the sprites are spread evenly over the frame.
+	 *
+	 * Use it with a task pool with pinned threads, see setTaskPool, and a framebuffer prepared
+	 * by clearFramebuffer. The first band belongs to thread 0 of the pool, i.e. to whichever thread
+	 * calls this method or the render methods. A pool with pinned threads pins all of those to the
+	 * same processor, so the first band is allocated and rendered on the same processor as well,
+	 * even if renderAsync renders it on another thread. Tiles, streamed bands and viewports don't
+	 * use the RasterLines and are scheduled as before. Forgets the bound scene.
+	 *
+	 * @param lineOwnership True to bind the bands of lines to threads, false to let any thread render any line.
+	 */
+	void setLineOwnership(bool lineOwnership) {
+		unbindScene();
+		this->lineOwnership = lineOwnership;
+		allocateRasterLines();
+		lastEstimatedCosts.clear();
+	}
+
+	bool hasLineOwnership() const {
+		return lineOwnership;
+	}
+
+	/**
+	 * Fills a framebuffer of the size of this renderer with zeros, each block of lines on the thread
+	 * that renders it with line ownership (see setLineOwnership), or on any thread otherwise. Meant
+	 * for freshly allocated framebuffers: with a first-touch policy like the default one of Linux,
+	 * the memory of each band of lines then ends up on the NUMA node of the thread that owns it.
+	 *
+	 * @param framebuffer
+	 * @param pitch       The distance between two lines of the framebuffer, in bytes.
+	 */
+	void clearFramebuffer(uint8_t *framebuffer, size_t pitch) {
+		const size_t lineSize = width * pixelFormat.getBytesPerPixel();
+		const auto clearBlock = [&](int block, int) {
+			const int endY = min(height, (block + 1) * blockSize);
+			for (int y = block * blockSize; y < endY; y++) {
+				memset(framebuffer + y * pitch, 0, lineSize);
+			}
+		};
+
+		if (lineOwnership) {
+			taskPool->parallelForOwned(0, getNumBlocks(), clearBlock);
+		} else {
+			taskPool->parallelFor(0, getNumBlocks(), clearBlock);
+		}
+		dirtyFramebuffer = nullptr;
+	}
+
+	/**
+	 * Enables measuring how long each task of a frame takes, see getLoadBalance. The work of
+	 * each frame is split into tasks ahead of time, balanced by costs estimated from the number
+	 * of sprites on each line, block or tile. Measuring costs two clock reads per task.
+	 *
+	 * @param measureCosts    True to measure the tasks of each frame.
+	 * @param useCostFeedback True to balance each frame by the measured times of the previous one
+	 *                        instead, scaled by how much the estimate of each task changed.
+	 *                        Works best if the sprites don't change much from frame to frame.
+	 *                        Ignored unless measuring.
+	 */
+	void setCostMeasurement(bool measureCosts, bool useCostFeedback = false) {
+		this->measureCosts = measureCosts;
+		this->useCostFeedback = useCostFeedback;
+		loadBalance.clear();
+		lastEstimatedCosts.clear();
+	}
+
+	/**
+	 * @return The estimated costs and measured times of the tasks of the last frame.
+	 *         Empty unless measuring is enabled by setCostMeasurement.
+	 */
+	const LoadBalance& getLoadBalance() const {
+		return loadBalance;
+	}
+
+	/**
+	 * @return The stats policy, e.g. to read the statistics of the last frame from CollectFrameStats
+	 *         or to set its trace hook. Must not be used while rendering.
+	 */
+	StatsPolicy& getFrameStats() {
+		return frameStats;
+	}
+
+	/**
+	 * Renders the given sprites. Not related to any SpriteScene; all sprites are
+	 * distributed to the RasterLines from scratch.
+	 *
+	 * @param sprites
+	 * @param framebuffer
+	 * @param pitch       The distance between two lines of the framebuffer, in bytes.
+	 */
+	void render(const vector<Sprite>& sprites, uint8_t *framebuffer, size_t pitch) {
+		frameStats.beginFrame(taskPool->getNumThreads());
+
+		//We don't keep anything around between frames in this mode.
+		unbindScene();
+
+		//First distribute the sprites to the RasterLines that make up the framebuffer
+		frameStats.beginPhase(FramePhase::Cull);
+		collectVisibleSprites(sprites);
+		frameStats.endPhase(FramePhase::Cull);
+		renderFrameInstances(framebuffer, pitch);
+	}
+
+	/**
+	 * Renders the given sprites. Like render(const vector<Sprite>&, ...), but culling
+	 * and distributing the sprites only reads their coordinates from the arrays.
+	 *
+	 * @param sprites
+	 * @param framebuffer
+	 * @param pitch       The distance between two lines of the framebuffer, in bytes.
+	 */
+	void render(const SpriteArray& sprites, uint8_t *framebuffer, size_t pitch) {
+		frameStats.beginFrame(taskPool->getNumThreads());
+
+		//We don't keep anything around between frames in this mode.
+		unbindScene();
+
+		frameStats.beginPhase(FramePhase::Cull);
+		collectVisibleSprites(sprites);
+		frameStats.endPhase(FramePhase::Cull);
+		renderFrameInstances(framebuffer, pitch);
+	}
+
+	/**
+	 * Renders the given sprites without a framebuffer for the whole frame. The frame is rendered
+	 * in bands of full lines, and each band is passed to the callback as soon as it and all bands
+	 * above it are done, so e.g. an encoder can start on the top of the frame while the bottom
+	 * is still being rendered. Only a few bands per thread are kept in memory at a time: the
+	 * threads keep rendering further bands while the callback is busy, until they run out of
+	 * band buffers. Ignores the tile size. Can't be used with setBackgroundUntouched, as there is no
+	 * framebuffer whose contents could be kept.
+	 *
+	 * @param sprites
+	 * @param bandHeight The number of lines per band, e.g. blockSize or the height of a macroblock row.
+	 *                   The last band may have fewer lines.
+	 * @param callback   Called with each band from top to bottom, one band at a time, on any of the
+	 *                   threads of the task pool. The band's pixels are only valid during the call.
+	 *                   Must not use this renderer.
+	 */
+	void renderStreaming(const vector<Sprite>& sprites, int bandHeight, const BandCallback& callback) {
+		frameStats.beginFrame(taskPool->getNumThreads());
+
+		//We don't keep anything around between frames in this mode.
+		unbindScene();
+
+		frameStats.beginPhase(FramePhase::Cull);
+		collectVisibleSprites(sprites);
+		frameStats.endPhase(FramePhase::Cull);
+		streamFrameInstances(bandHeight, callback);
+	}
+
+	/**
+	 * Like renderStreaming(const vector<Sprite>&, ...), but for a SpriteArray.
+	 *
+	 * @param sprites
+	 * @param bandHeight
+	 * @param callback
+	 */
+	void renderStreaming(const SpriteArray& sprites, int bandHeight, const BandCallback& callback) {
+		frameStats.beginFrame(taskPool->getNumThreads());
+
+		//We don't keep anything around between frames in this mode.
+		unbindScene();
+
+		frameStats.beginPhase(FramePhase::Cull);
+		collectVisibleSprites(sprites);
+		frameStats.endPhase(FramePhase::Cull);
+		streamFrameInstances(bandHeight, callback);
+	}
+
+	/**
+	 * Starts rendering the given sprites in the background and returns at once, so the
+	 * caller can present or upload the previous frame meanwhile (e.g. into a second buffer).
+	 * The frame is rendered by a thread that is kept for all asynchronous frames of this
+	 * renderer, with the same threads helping it as in render. A task pool with pinned threads
+	 * pins that thread like any other thread that calls render, see TaskPool.
+	 *
+	 * The renderer must not be used in any other way until the returned future is ready.
+	 *
+	 * @param sprites     A snapshot of the sprites, kept until the frame is done.
+	 * @param framebuffer Must stay valid until the frame is done.
+	 * @param pitch       The distance between two lines of the framebuffer, in bytes.
+	 * @return            Becomes ready once the frame has been rendered into the framebuffer.
+	 */
+	future<void> renderAsync(vector<Sprite> sprites, uint8_t *framebuffer, size_t pitch) {
+		return getBackgroundWorker().submit([this, sprites = move(sprites), framebuffer, pitch]() {
+			render(sprites, framebuffer, pitch);
+		});
+	}
+
+	/**
+	 * Starts rendering the given sprites in the background, see renderAsync(vector<Sprite>, ...).
+	 *
+	 * @param sprites     A snapshot of the sprites, kept until the frame is done.
+	 * @param framebuffer Must stay valid until the frame is done.
+	 * @param pitch       The distance between two lines of the framebuffer, in bytes.
+	 * @return            Becomes ready once the frame has been rendered into the framebuffer.
+	 */
+	future<void> renderAsync(SpriteArray sprites, uint8_t *framebuffer, size_t pitch) {
+		return getBackgroundWorker().submit([this, sprites = move(sprites), framebuffer, pitch]() {
+			render(sprites, framebuffer, pitch);
+		});
+	}
+
+	/**
+	 * Renders the given scene. The RasterLines keep the scene's sprites between frames,
+	 * so only the sprites that changed since the last call need to be redistributed.
+	 *
+	 * The scene must not be modified while rendering, and any sprite that is part of the
+	 * scene must stay alive until the next call to a render method.
+	 *
+	 * @param scene
+	 * @param framebuffer
+	 * @param pitch       The distance between two lines of the framebuffer, in bytes.
+	 */
+	void render(const SpriteScene& scene, uint8_t *framebuffer, size_t pitch) {
+		frameStats.beginFrame(taskPool->getNumThreads());
+		prepareThreadArenas();
+
+		frameStats.beginPhase(FramePhase::SyncScene);
+		syncScene(scene);
+		frameStats.endPhase(FramePhase::SyncScene);
+
+		renderRasterLines(framebuffer, pitch);
+	}
+
+	/**
+	 * Renders the part of the given scene that a camera sees. The camera's position is the
+	 * coordinate of the scene that ends up in the top left corner of the framebuffer.
+	 *
+	 * Unlike render(const SpriteScene&, ...), nothing is kept between frames, so moving the camera
+	 * costs nothing extra. If the scene has a spatial index, finding the visible sprites costs
+	 * about as much as there are visible sprites, no matter how large the rest of the scene is.
+	 *
+	 * The scene must not be modified while rendering.
+	 *
+	 * @param scene
+	 * @param framebuffer
+	 * @param pitch       The distance between two lines of the framebuffer, in bytes.
+	 * @param cameraX
+	 * @param cameraY
+	 */
+	void render(const SpriteScene& scene, uint8_t *framebuffer, size_t pitch, int32_t cameraX, int32_t cameraY) {
+		frameStats.beginFrame(taskPool->getNumThreads());
+
+		//We don't keep anything around between frames in this mode.
+		unbindScene();
+
+		frameStats.beginPhase(FramePhase::Cull);
+		collectVisibleSprites(scene, cameraX, cameraY);
+		frameStats.endPhase(FramePhase::Cull);
+		renderFrameInstances(framebuffer, pitch);
+	}
+
+	/**
+	 * Renders several parts of the given scene at once, each into its own framebuffer, e.g. the
+	 * halves of a split screen and a minimap. Cheaper than rendering them one by one: the sprites
+	 * are culled, sorted and binned once for all of them, and the work of all viewports is
+	 * balanced across the task pool together. The viewports may have any size, independent of the
+	 * size of this renderer, and may show overlapping parts of the scene. Their framebuffers must
+	 * not overlap. Like render(scene, framebuffer, pitch, cameraX, cameraY), nothing is kept
+	 * between frames, and all viewports are rendered in tiles when tiled mode is enabled.
+	 *
+	 * The scene must not be modified while rendering.
+	 *
+	 * @param scene
+	 * @param viewports
+	 */
+	void render(const SpriteScene& scene, const vector<Viewport>& viewports) {
+		frameStats.beginFrame(taskPool->getNumThreads());
+
+		//We don't keep anything around between frames in this mode.
+		unbindScene();
+
+		frameStats.beginPhase(FramePhase::Cull);
+		collectVisibleSprites(scene, viewports);
+		frameStats.endPhase(FramePhase::Cull);
+		renderViewports(viewports);
+	}
+
+	/**
+	 * Renders only the parts of the scene that changed since the last call.
+	 * The framebuffer must be the same one (with the same pitch) as in the last call
+	 * and still contain what has been rendered into it. If it isn't, if the scene
+	 * isn't bound or changed too much, everything is rendered.
+	 *
+	 * The scene must not be modified while rendering, and any sprite that is part of the
+	 * scene must stay alive until the next call to a render method.
+	 *
+	 * @param scene
+	 * @param framebuffer
+	 * @param pitch       The distance between two lines of the framebuffer, in bytes.
+	 * @return            The non-overlapping rectangles of the framebuffer that have been rendered.
+	 */
+	vector<IntRectangle<int32_t>> renderDirty(const SpriteScene& scene, uint8_t *framebuffer, size_t pitch) {
+		const IntRectangle<int32_t> viewport(0, 0, width, height);
+		const bool canReuseFramebuffer = (framebuffer == dirtyFramebuffer) && (pitch == dirtyFramebufferPitch);
+
+		frameStats.beginFrame(taskPool->getNumThreads());
+
+		vector<IntRectangle<int32_t>> dirtyRects;
+		frameStats.beginPhase(FramePhase::SyncScene);
+		const bool appliedChanges = syncScene(scene, &dirtyRects);
+		frameStats.endPhase(FramePhase::SyncScene);
+		if (!appliedChanges || !canReuseFramebuffer) {
+			dirtyRects.assign(1, viewport);
+		}
+		mergeOverlappingRects(dirtyRects);
+
+		prepareThreadArenas();
+
+		//Only the dirty parts of each line cost anything.
+		taskCosts.assign(height, 1);
+		for (const IntRectangle<int32_t>& rect: dirtyRects) {
+			for (int32_t y = rect.y; y <= rect.getLastY(); y++) {
+				taskCosts[y] += rect.width + spriteRowCost * rasterLines[y]->getNumSprites();
+			}
+		}
+
+		runLineTasks(TaskKind::DirtyLines, [&](int y, int threadIndex) {
+			uint8_t *framebufferLine = framebuffer + y * pitch;
+			const LineBackground background = getLineBackground(framebufferLine, 0, y);
+			for (const IntRectangle<int32_t>& rect: dirtyRects) {
+				if (y >= rect.y && y <= rect.getLastY()) {
+					rasterLines[y]->render(framebufferLine, y, pixelFormat, background, rect.x, rect.getLastX() + 1, getThreadArena(threadIndex), frameStats.getCounters(threadIndex));
+				}
+			}
+		});
+
+		resetThreadArenas();
+
+		dirtyFramebuffer = framebuffer;
+		dirtyFramebufferPitch = pitch;
+		return dirtyRects;
+	}
 
 };
 
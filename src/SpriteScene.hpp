@@ -0,0 +1,380 @@
+/*
+ * SpriteScene.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef SPRITESCENE_HPP_
+#define SPRITESCENE_HPP_
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <optional>
+#include <atomic>
+#include <algorithm>
+#include <cassert>
+
+#include "IntRectangle.hpp"
+#include "SpatialGrid.hpp"
+#include "Sprite.hpp"
+
+using namespace std;
+using namespace ttlhacker;
+
+namespace mmo2020 {
+
+
+/**
+ * Refers to a sprite within a SpriteScene.
+ * Stays valid until the sprite is removed from the scene.
+ */
+struct SpriteHandle {
+	uint32_t index;
+	uint32_t generation;
+
+	bool operator==(const SpriteHandle& other) const {
+		return (index == other.index) && (generation == other.generation);
+	}
+
+	bool operator!=(const SpriteHandle& other) const {
+		return !(*this == other);
+	}
+};
+
+/**
+ * A retained set of sprites. Sprites are addressed by stable handles and
+ * never move in memory while they are part of the scene.
+ *
+ * Every modification is recorded in a journal, which allows SpriteRenderers
+ * to only update the parts of their state that belong to changed sprites.
+ */
+class SpriteScene {
+private:
+	struct Slot {
+		optional<Sprite> sprite;
+		uint32_t generation = 0;
+	};
+
+	/**
+	 * The journal doesn't grow larger than this many entries or twice the number of slots,
+	 * whatever is larger. Once it does, it's dropped and all renderers have to start over.
+	 */
+	static constexpr size_t minJournalCapacity = 1024;
+
+	/**
+	 * Unique identifier of this scene, so renderers can tell scenes apart
+	 * even if one is allocated at the address of another destroyed scene.
+	 */
+	uint64_t id;
+
+	/**
+	 * A deque because it doesn't move its elements when growing,
+	 * so renderers may keep pointers to the sprites.
+	 */
+	deque<Slot> slots;
+
+	/**
+	 * Indices of all slots that are currently unused.
+	 */
+	vector<uint32_t> freeSlots;
+
+	size_t numSprites = 0;
+
+	/**
+	 * Indices of the slots that changed, in the order of the changes.
+	 * May contain the same index several times.
+	 */
+	vector<uint32_t> journal;
+
+	/**
+	 * The version of the scene before the first change in the journal.
+	 */
+	uint64_t journalBaseVersion = 0;
+
+	/**
+	 * The positions of all sprites, if enabled.
+	 */
+	optional<SpatialGrid> spatialIndex;
+
+	static uint64_t makeId() {
+		static atomic<uint64_t> nextId(1);
+		return nextId++;
+	}
+
+	void recordChange(uint32_t index) {
+		if (journal.size() >= max(minJournalCapacity, 2 * slots.size())) {
+			journalBaseVersion += journal.size();
+			journal.clear();
+		}
+		journal.push_back(index);
+	}
+
+	Slot& getSlot(SpriteHandle handle) {
+		assert(isValid(handle));
+		return slots[handle.index];
+	}
+
+	void addToSpatialIndex(uint32_t index) {
+		if (spatialIndex) {
+			spatialIndex->insert(index, slots[index].sprite->position);
+		}
+	}
+
+	void removeFromSpatialIndex(uint32_t index) {
+		if (spatialIndex) {
+			spatialIndex->remove(index, slots[index].sprite->position);
+		}
+	}
+
+public:
+	SpriteScene():
+		id(makeId())
+	{
+		//Nothing else to do
+	}
+
+	/**
+	 * Copies get a new id, so renderers don't confuse them with the original.
+	 */
+	SpriteScene(const SpriteScene& other):
+		id(makeId()), slots(other.slots), freeSlots(other.freeSlots), numSprites(other.numSprites), spatialIndex(other.spatialIndex)
+	{
+		//Nothing else to do
+	}
+
+	SpriteScene& operator=(const SpriteScene& other) {
+		if (this != &other) {
+			id = makeId();
+			slots = other.slots;
+			freeSlots = other.freeSlots;
+			numSprites = other.numSprites;
+			spatialIndex = other.spatialIndex;
+			journal.clear();
+			journalBaseVersion = 0;
+		}
+		return *this;
+	}
+
+	/**
+	 * Adds a sprite to this scene.
+	 *
+	 * @param sprite
+	 * @return The handle to refer to the sprite with.
+	 */
+	SpriteHandle addSprite(Sprite sprite) {
+		uint32_t index;
+		if (!freeSlots.empty()) {
+			index = freeSlots.back();
+			freeSlots.pop_back();
+		} else {
+			index = slots.size();
+			slots.emplace_back();
+		}
+
+		Slot& slot = slots[index];
+		slot.sprite.emplace(move(sprite));
+		numSprites++;
+		addToSpatialIndex(index);
+		recordChange(index);
+
+		return SpriteHandle{index, slot.generation};
+	}
+
+	/**
+	 * Moves a sprite to a new position, keeping its size.
+	 *
+	 * @param handle
+	 * @param x
+	 * @param y
+	 */
+	void moveSprite(SpriteHandle handle, int32_t x, int32_t y) {
+		Slot& slot = getSlot(handle);
+		IntRectangle<int32_t>& position = slot.sprite->position;
+		if (position.x == x && position.y == y) {
+			return;
+		}
+
+		removeFromSpatialIndex(handle.index);
+		position.x = x;
+		position.y = y;
+		addToSpatialIndex(handle.index);
+		recordChange(handle.index);
+	}
+
+	/**
+	 * Replaces a sprite with another one, keeping its handle.
+	 *
+	 * @param handle
+	 * @param sprite
+	 */
+	void updateSprite(SpriteHandle handle, Sprite sprite) {
+		Slot& slot = getSlot(handle);
+		removeFromSpatialIndex(handle.index);
+		*slot.sprite = move(sprite);
+		addToSpatialIndex(handle.index);
+		recordChange(handle.index);
+	}
+
+	/**
+	 * Records a change of a sprite without modifying it, for example because
+	 * the pixels returned by its getters changed.
+	 *
+	 * @param handle
+	 */
+	void invalidateSprite(SpriteHandle handle) {
+		assert(isValid(handle));
+		recordChange(handle.index);
+	}
+
+	/**
+	 * Removes a sprite from this scene. The handle becomes invalid.
+	 *
+	 * @param handle
+	 */
+	void removeSprite(SpriteHandle handle) {
+		Slot& slot = getSlot(handle);
+		removeFromSpatialIndex(handle.index);
+		slot.sprite.reset();
+		slot.generation++;
+		numSprites--;
+		freeSlots.push_back(handle.index);
+		recordChange(handle.index);
+	}
+
+	/**
+	 * Starts keeping the positions of all sprites in a spatial index, which makes finding the
+	 * sprites within a rectangle (see forEachSpriteIn) cost about as much as there are sprites
+	 * in it, rather than as many as there are in the scene. Adding, moving and removing sprites
+	 * becomes slightly more expensive. Worth it for large worlds of which only a small part is
+	 * rendered at a time.
+	 *
+	 * @param cellSize The size of the cells of the index, ideally somewhat larger than most sprites.
+	 */
+	void enableSpatialIndex(int32_t cellSize = 256) {
+		spatialIndex.emplace(cellSize);
+		for (uint32_t index = 0; index < slots.size(); index++) {
+			if (slots[index].sprite) {
+				addToSpatialIndex(index);
+			}
+		}
+	}
+
+	/**
+	 * @return True if the positions of the sprites are kept in a spatial index.
+	 */
+	bool hasSpatialIndex() const {
+		return spatialIndex.has_value();
+	}
+
+	/**
+	 * Calls callback(slotIndex, sprite) once for each sprite that intersects the given rectangle,
+	 * in no particular order. Uses the spatial index if enabled, otherwise looks at all sprites.
+	 *
+	 * @param rect
+	 * @param callback
+	 */
+	template<typename Callback>
+	void forEachSpriteIn(const IntRectangle<int32_t>& rect, Callback callback) const {
+		if (spatialIndex) {
+			spatialIndex->query(rect, [&](uint32_t index) {
+				callback(index, *slots[index].sprite);
+			});
+			return;
+		}
+
+		for (uint32_t index = 0; index < slots.size(); index++) {
+			const Slot& slot = slots[index];
+			if (slot.sprite && slot.sprite->position.intersects(rect)) {
+				callback(index, *slot.sprite);
+			}
+		}
+	}
+
+	/**
+	 * @param handle
+	 * @return True if the handle refers to a sprite of this scene.
+	 */
+	bool isValid(SpriteHandle handle) const {
+		return (handle.index < slots.size())
+				&& slots[handle.index].sprite
+				&& (slots[handle.index].generation == handle.generation);
+	}
+
+	/**
+	 * @param handle Must be valid.
+	 * @return The sprite the handle refers to.
+	 */
+	const Sprite& getSprite(SpriteHandle handle) const {
+		assert(isValid(handle));
+		return *slots[handle.index].sprite;
+	}
+
+	/**
+	 * @return The number of sprites in this scene.
+	 */
+	size_t size() const {
+		return numSprites;
+	}
+
+	/**
+	 * @return The unique identifier of this scene.
+	 */
+	uint64_t getId() const {
+		return id;
+	}
+
+	/**
+	 * @return The number of slots. Valid slot indices are smaller than this.
+	 */
+	size_t getSlotCount() const {
+		return slots.size();
+	}
+
+	/**
+	 * @param index
+	 * @return The sprite in the given slot or nullptr if the slot is unused.
+	 */
+	const Sprite * getSpriteInSlot(uint32_t index) const {
+		const Slot& slot = slots[index];
+		return slot.sprite ? &*slot.sprite : nullptr;
+	}
+
+	/**
+	 * @return The current version of this scene. Increases with every change.
+	 */
+	uint64_t getVersion() const {
+		return journalBaseVersion + journal.size();
+	}
+
+	/**
+	 * @param version
+	 * @return True if the changes since the given version are still recorded.
+	 */
+	bool hasChangesSince(uint64_t version) const {
+		return (version >= journalBaseVersion) && (version <= getVersion());
+	}
+
+	/**
+	 * @param version A version for which hasChangesSince returns true.
+	 * @return Iterator to the slot index of the first change after the given version.
+	 */
+	vector<uint32_t>::const_iterator getChangesSince(uint64_t version) const {
+		assert(hasChangesSince(version));
+		return journal.begin() + (version - journalBaseVersion);
+	}
+
+	/**
+	 * @return End iterator to go with getChangesSince.
+	 */
+	vector<uint32_t>::const_iterator getChangesEnd() const {
+		return journal.end();
+	}
+};
+
+
+}
+
+
+#endif /* SPRITESCENE_HPP_ */
@@ -0,0 +1,507 @@
+/*
+ * TaskPool.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef TASKPOOL_HPP_
+#define TASKPOOL_HPP_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <cassert>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+namespace ttlhacker {
+
+
+/**
+ * A pool of persistent threads that run parallel loops with work stealing.
+ *
+ * The indices of a loop are split evenly between all threads of the pool and the
+ * calling thread, which takes part in the loop. Each of them works through its own
+ * range in batches and, once it runs out, steals half of the remaining range of
+ * another one. With a cost function, the ranges and batches are split by their
+ * estimated cost instead of by their number of indices.
+ *
+ * parallelForOwned instead gives each thread a fixed range and doesn't steal, so the same
+ * indices always end up on the same thread.
+ *
+ * Loops from different threads are run one after another. Loops must not be nested.
+ * A pool of one thread doesn't start any threads and runs each loop on the calling thread.
+ */
+class TaskPool {
+private:
+	/**
+	 * The remaining range of indices of one thread, begin in the lower and end in the upper 32 bits.
+	 * The owner takes from the front, thieves take from the back. On its own cache line.
+	 */
+	struct alignas(64) WorkQueue {
+		atomic<uint64_t> range{0};
+	};
+
+	/**
+	 * The loop that is currently running.
+	 */
+	struct Loop {
+		int begin;
+		void (*runBody)(const void *body, int index, int threadIndex);
+		const void *body;
+		size_t (*getCost)(const void *cost, int index);
+		const void *cost;
+
+		/**
+		 * The cost that a thread takes at once from its own range.
+		 */
+		size_t batchCost;
+
+		/**
+		 * False if each thread must only run the indices of its own range.
+		 */
+		bool canSteal;
+	};
+
+	/**
+	 * Stands in for the cost function of loops without one.
+	 */
+	struct NoCost {
+		size_t operator()(int) const {
+			return 1;
+		}
+	};
+
+	static constexpr int spinsBeforeSleeping = 20000;
+
+	int numThreads;
+	bool pinThreads;
+
+	/**
+	 * The number of processors, at least 1.
+	 */
+	int numCpus;
+
+	unique_ptr<WorkQueue[]> queues;
+	Loop loop;
+
+	/**
+	 * Serializes the loops of different callers.
+	 */
+	mutex loopMutex;
+
+	/**
+	 * Increased for every loop. Workers start working once it changes.
+	 */
+	atomic<uint64_t> loopGeneration{0};
+
+	/**
+	 * The number of workers that haven't finished the current loop yet.
+	 */
+	atomic<int> numBusyWorkers{0};
+
+	mutex wakeMutex;
+	condition_variable wakeCondition;
+	bool isStopping = false;
+
+	vector<thread> workers;
+
+	static uint64_t packRange(uint32_t begin, uint32_t end) {
+		return (uint64_t)begin | ((uint64_t)end << 32);
+	}
+
+	static uint32_t getRangeBegin(uint64_t range) {
+		return (uint32_t)range;
+	}
+
+	static uint32_t getRangeEnd(uint64_t range) {
+		return (uint32_t)(range >> 32);
+	}
+
+	static void pause() {
+#if defined(__SSE2__)
+		_mm_pause();
+#else
+		this_thread::yield();
+#endif
+	}
+
+	/**
+	 * Runs a batch from the front of the given thread's own range.
+	 *
+	 * @param threadIndex
+	 * @return False if the range is empty.
+	 */
+	bool runOwnBatch(int threadIndex) {
+		WorkQueue& queue = queues[threadIndex];
+		uint64_t range = queue.range.load(memory_order_acquire);
+		while (true) {
+			const uint32_t begin = getRangeBegin(range);
+			const uint32_t end = getRangeEnd(range);
+			if (begin >= end) {
+				return false;
+			}
+
+			//Take indices until the batch is expensive enough, at least one.
+			uint32_t batchEnd = begin + 1;
+			if (loop.getCost) {
+				size_t cost = loop.getCost(loop.cost, loop.begin + begin);
+				while (batchEnd < end && cost < loop.batchCost) {
+					cost += loop.getCost(loop.cost, loop.begin + batchEnd);
+					batchEnd++;
+				}
+			} else {
+				batchEnd = min<uint32_t>(end, begin + (uint32_t)loop.batchCost);
+			}
+
+			if (queue.range.compare_exchange_weak(range, packRange(batchEnd, end), memory_order_acq_rel)) {
+				for (uint32_t i = begin; i < batchEnd; i++) {
+					loop.runBody(loop.body, loop.begin + i, threadIndex);
+				}
+				return true;
+			}
+		}
+	}
+
+	/**
+	 * Moves the back half of another thread's range into the given thread's (empty) range.
+	 *
+	 * @param threadIndex
+	 * @return False if there is nothing left to steal.
+	 */
+	bool steal(int threadIndex) {
+		for (int offset = 1; offset < numThreads; offset++) {
+			WorkQueue& victim = queues[(threadIndex + offset) % numThreads];
+			uint64_t range = victim.range.load(memory_order_acquire);
+			while (true) {
+				const uint32_t begin = getRangeBegin(range);
+				const uint32_t end = getRangeEnd(range);
+				if (begin >= end) {
+					break;
+				}
+
+				const uint32_t middle = begin + (end - begin) / 2;
+				if (victim.range.compare_exchange_weak(range, packRange(begin, middle), memory_order_acq_rel)) {
+					//Nobody else writes to an empty range, so a plain store is fine.
+					queues[threadIndex].range.store(packRange(middle, end), memory_order_release);
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * Works on the current loop until there's nothing left to take.
+	 *
+	 * @param threadIndex
+	 */
+	void participate(int threadIndex) {
+		while (runOwnBatch(threadIndex) || (loop.canSteal && steal(threadIndex))) {
+			//Keep going
+		}
+	}
+
+	void runWorker(int threadIndex) {
+		uint64_t seenGeneration = 0;
+		while (true) {
+			//The next loop usually follows quickly, so spin for a while before going to sleep.
+			int spins = 0;
+			while (loopGeneration.load(memory_order_acquire) == seenGeneration && spins < spinsBeforeSleeping) {
+				pause();
+				spins++;
+			}
+			if (loopGeneration.load(memory_order_acquire) == seenGeneration) {
+				unique_lock<mutex> lock(wakeMutex);
+				wakeCondition.wait(lock, [&]() {
+					return isStopping || loopGeneration.load(memory_order_acquire) != seenGeneration;
+				});
+				if (isStopping) {
+					return;
+				}
+			}
+
+			seenGeneration = loopGeneration.load(memory_order_acquire);
+			participate(threadIndex);
+			numBusyWorkers.fetch_sub(1, memory_order_acq_rel);
+		}
+	}
+
+	/**
+	 * Pins the calling thread to the given processor, if supported.
+	 *
+	 * @param cpu
+	 */
+	static void pinToCpu(int cpu) {
+#if defined(__linux__)
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+		(void)cpu;
+#endif
+	}
+
+	/**
+	 * @param threadIndex
+	 * @return The processor that the thread with the given index is pinned to if the threads are pinned.
+	 */
+	int getCpu(int threadIndex) const {
+		return threadIndex % numCpus;
+	}
+
+	/**
+	 * @return The processor that the calling thread has been pinned to by a pool, or -1.
+	 */
+	static int& getPinnedCpu() {
+		thread_local int pinnedCpu = -1;
+		return pinnedCpu;
+	}
+
+	/**
+	 * Pins the calling thread to the processor of thread 0, unless it already is. Only pins once
+	 * per thread, so it costs next to nothing from the second loop on.
+	 */
+	void pinCallingThread() const {
+		const int cpu = getCpu(0);
+		if (getPinnedCpu() != cpu) {
+			pinToCpu(cpu);
+			getPinnedCpu() = cpu;
+		}
+	}
+
+	template<typename Body, typename Cost>
+	void run(int begin, int end, const Body& body, const Cost *cost, bool canSteal) {
+		const int count = end - begin;
+		if (count <= 0) {
+			return;
+		}
+
+		lock_guard<mutex> lock(loopMutex);
+
+		if (pinThreads) {
+			pinCallingThread();
+		}
+
+		//A single index belongs to the last thread if it can't be stolen.
+		if (numThreads == 1 || (count == 1 && canSteal)) {
+			for (int i = begin; i < end; i++) {
+				body(i, 0);
+			}
+			return;
+		}
+
+		loop.begin = begin;
+		loop.runBody = [](const void *body, int index, int threadIndex) {
+			(*static_cast<const Body *>(body))(index, threadIndex);
+		};
+		loop.body = &body;
+		loop.canSteal = canSteal;
+
+		//Batches that are small enough to balance the load, but not so small that claiming them costs more than running them.
+		constexpr int batchesPerThread = 8;
+		if (cost) {
+			size_t totalCost = 0;
+			for (int i = begin; i < end; i++) {
+				totalCost += (*cost)(i);
+			}
+			loop.getCost = [](const void *cost, int index) {
+				return (size_t)(*static_cast<const Cost *>(cost))(index);
+			};
+			loop.cost = cost;
+			loop.batchCost = max<size_t>(1, totalCost / ((size_t)numThreads * batchesPerThread));
+
+			//Split at equal shares of the total cost, so stealing only has to make up for wrong estimates.
+			uint32_t rangeBegin = 0;
+			size_t costBefore = 0;
+			uint32_t i = 0;
+			for (int t = 0; t < numThreads; t++) {
+				const size_t costEnd = (t == numThreads - 1) ? totalCost + 1 : totalCost * (t + 1) / numThreads;
+				while (i < (uint32_t)count && costBefore < costEnd) {
+					costBefore += (*cost)(begin + i);
+					i++;
+				}
+				queues[t].range.store(packRange(rangeBegin, i), memory_order_relaxed);
+				rangeBegin = i;
+			}
+		} else {
+			loop.getCost = nullptr;
+			loop.cost = nullptr;
+			loop.batchCost = max<size_t>(1, count / (numThreads * batchesPerThread));
+
+			for (int t = 0; t < numThreads; t++) {
+				const uint32_t rangeBegin = (uint64_t)count * t / numThreads;
+				const uint32_t rangeEnd = (uint64_t)count * (t + 1) / numThreads;
+				queues[t].range.store(packRange(rangeBegin, rangeEnd), memory_order_relaxed);
+			}
+		}
+
+		numBusyWorkers.store(numThreads - 1, memory_order_relaxed);
+		{
+			lock_guard<mutex> wakeLock(wakeMutex);
+			loopGeneration.fetch_add(1, memory_order_release);
+		}
+		wakeCondition.notify_all();
+
+		participate(0);
+
+		//Wait for the batches that the workers are still running. Yield after a while,
+		//in case they share this thread's processor.
+		int spins = 0;
+		while (numBusyWorkers.load(memory_order_acquire) != 0) {
+			if (spins < spinsBeforeSleeping) {
+				pause();
+				spins++;
+			} else {
+				this_thread::yield();
+			}
+		}
+	}
+
+public:
+	/**
+	 * @param numThreads The number of threads that run each loop, including the calling thread.
+	 *                   0 for one per processor.
+	 * @param pinThreads True to pin each thread to a processor of its own: thread t (see getNumThreads)
+	 *                   to processor t modulo the number of processors. Thread 0 is whichever thread
+	 *                   calls a loop, so every thread that calls a loop is pinned to processor 0 from
+	 *                   then on, e.g. a render thread, and stays pinned after the loop.
+	 */
+	explicit TaskPool(int numThreads = 0, bool pinThreads = false):
+		numThreads(numThreads), pinThreads(pinThreads), numCpus(max(1u, thread::hardware_concurrency()))
+	{
+		assert(numThreads >= 0);
+		if (this->numThreads == 0) {
+			this->numThreads = numCpus;
+		}
+
+		queues.reset(new WorkQueue[this->numThreads]);
+		for (int t = 1; t < this->numThreads; t++) {
+			workers.emplace_back([this, t]() {
+				if (this->pinThreads) {
+					pinToCpu(getCpu(t));
+				}
+				runWorker(t);
+			});
+		}
+	}
+
+	TaskPool(const TaskPool&) = delete;
+	TaskPool& operator=(const TaskPool&) = delete;
+
+	~TaskPool() {
+		{
+			lock_guard<mutex> lock(wakeMutex);
+			isStopping = true;
+		}
+		wakeCondition.notify_all();
+		for (thread& worker: workers) {
+			worker.join();
+		}
+	}
+
+	/**
+	 * @return The number of threads that run each loop, including the calling thread.
+	 *         The thread indices passed to the loop bodies are below this.
+	 */
+	int getNumThreads() const {
+		return numThreads;
+	}
+
+	/**
+	 * Calls body(i, threadIndex) for every i from begin up to end in parallel and returns
+	 * once all calls are done. threadIndex identifies the calling thread within the loop;
+	 * the thread that called parallelFor has index 0.
+	 *
+	 * @param begin
+	 * @param end
+	 * @param body
+	 */
+	template<typename Body>
+	void parallelFor(int begin, int end, const Body& body) {
+		run(begin, end, body, (const NoCost *)nullptr, true);
+	}
+
+	/**
+	 * Like parallelFor(begin, end, body), but each thread starts with a range of about the
+	 * same total cost, and takes as many indices at once as necessary for a reasonable share
+	 * of it. Useful if some indices are much more expensive than others. cost is called
+	 * several times per index, so it should be cheap, e.g. a lookup of precomputed costs.
+	 *
+	 * @param begin
+	 * @param end
+	 * @param body
+	 * @param cost  cost(i) returns the estimated cost of index i, in arbitrary units.
+	 */
+	template<typename Body, typename Cost>
+	void parallelFor(int begin, int end, const Body& body, const Cost& cost) {
+		run(begin, end, body, &cost, true);
+	}
+
+	/**
+	 * Like parallelFor(begin, end, body), but without stealing: thread t runs exactly the indices
+	 * from begin + count * t / getNumThreads() up to begin + count * (t + 1) / getNumThreads(), where
+	 * count is end - begin. So the same index of loops of the same length always runs on the
+	 * same thread, e.g. to keep data in the caches or on the NUMA node of the thread that
+	 * works on it. With count == getNumThreads(), each thread runs the index of its threadIndex.
+	 * Takes as long as the thread with the most expensive range.
+	 *
+	 * @param begin
+	 * @param end
+	 * @param body
+	 */
+	template<typename Body>
+	void parallelForOwned(int begin, int end, const Body& body) {
+		run(begin, end, body, (const NoCost *)nullptr, false);
+	}
+
+	/**
+	 * Lets the calling thread run on any processor again after a pool with pinned threads has
+	 * pinned it, e.g. once a program is done with such a pool. Does nothing if it isn't pinned.
+	 */
+	static void unpinCallingThread() {
+		if (getPinnedCpu() < 0) {
+			return;
+		}
+#if defined(__linux__)
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		const int numCpus = max(1u, thread::hardware_concurrency());
+		for (int cpu = 0; cpu < numCpus; cpu++) {
+			CPU_SET(cpu, &cpus);
+		}
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+		getPinnedCpu() = -1;
+	}
+
+	/**
+	 * @return A pool with one thread per processor that is shared by everything that doesn't bring its own.
+	 */
+	static shared_ptr<TaskPool> getDefault() {
+		static shared_ptr<TaskPool> defaultPool = make_shared<TaskPool>();
+		return defaultPool;
+	}
+};
+
+}
+
+
+#endif /* TASKPOOL_HPP_ */
@@ -0,0 +1,45 @@
+/*
+ * Viewport.hpp
+ *
+ *  Created on: 14.10.2026
+ *      Author: jonathan
+ */
+
+#ifndef VIEWPORT_HPP_
+#define VIEWPORT_HPP_
+
+#include <cstdint>
+#include <cstddef>
+
+#include "IntRectangle.hpp"
+
+using namespace std;
+using namespace ttlhacker;
+
+namespace mmo2020 {
+
+
+/**
+ * A part of a scene that is rendered into a framebuffer of its own, e.g. one half of a
+ * split screen or a minimap.
+ */
+struct Viewport {
+	/**
+	 * The part of the scene to render, in the scene's coordinates. Its top left corner
+	 * ends up in the top left corner of the framebuffer, and its size is the size of the framebuffer.
+	 */
+	IntRectangle<int32_t> area;
+
+	uint8_t *framebuffer;
+
+	/**
+	 * The distance between two lines of the framebuffer, in bytes.
+	 */
+	size_t pitch;
+};
+
+
+}
+
+
+#endif /* VIEWPORT_HPP_ */
@@ -8,6 +8,7 @@
 
 #include <iostream>
 #include <random>
+#include <future>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_video.h>
@@ -34,18 +35,14 @@ constexpr int maxTestSpriteSize = 700;
 
 /**
  * Pixel format to use for sending frames to SDL.
+ * Must match the one of the Renderer.
  */
 constexpr auto pixelFormat = SDL_PIXELFORMAT_ARGB8888;
 
 /**
- * @param r
- * @param g
- * @param b
- * @return The given color as a packed ARGB8888 value.
+ * The SpriteRenderer, specialized for the texture's pixel format.
  */
-uint32_t rgbToARGB8888(uint8_t r, uint8_t g, uint8_t b) {
-	return (0xFF << 24) | (r << 16) | (g << 8) | b;
-}
+using Renderer = SpriteRenderer<4, ARGB8888Format>;
 
 /**
  * Handles an incoming SDL event.
@@ -92,16 +89,27 @@ vector<Sprite> makeTestSprites() {
 		int x = xDistrib(gen);
 		int y = yDistrib(gen);
 
-		Sprite::PixelGetter pixelGetter;
+		Sprite::SpanGetter spanGetter;
 		if (i % 2) {
-			pixelGetter = [=](int x, int y) {return SpritePixel(x * 256 / spriteWidth, y * 256 / spriteHeight, 0);};
+			spanGetter = [=](int x, int y, int count, SpritePixel *pixels) {
+				for (int j = 0; j < count; j++) {
+					pixels[j] = SpritePixel((x + j) * 256 / spriteWidth, y * 256 / spriteHeight, 0);
+				}
+			};
 		} else {
-			pixelGetter = [=](int x, int y) {return SpritePixel(x * 256 / spriteWidth, 0, y * 256 / spriteHeight);};
+			spanGetter = [=](int x, int y, int count, SpritePixel *pixels) {
+				for (int j = 0; j < count; j++) {
+					pixels[j] = SpritePixel((x + j) * 256 / spriteWidth, 0, y * 256 / spriteHeight);
+				}
+			};
 		}
 		//pixelGetter = [=](int x, int y) {return SpritePixel(64, 0, 128);};
 
 		IntRectangle<int32_t> position(x, y, spriteWidth, spriteHeight);
-		sprites.emplace_back(position, pixelGetter, i);
+		sprites.emplace_back(position, spanGetter, i);
+
+		//The gradients don't have any transparent pixels.
+		sprites.back().isOpaque = true;
 	}
 
 	return sprites;
@@ -115,7 +123,12 @@ int main(int argc, char *argv[]) {
 	SDL_Texture *sdlTexture = nullptr;
 	uint32_t lastTime = 0;
 	uint32_t frameCount = 0;
-	unique_ptr<SpriteRenderer<>> mmoRenderer;
+	unique_ptr<Renderer> mmoRenderer;
+
+	//Two frames are in flight: one is uploaded and presented while the next one is rendered.
+	vector<uint32_t> frameBuffers[2];
+	int presentedFrame = 0;
+	future<void> renderedFrame;
 
 	vector<Sprite> sprites = makeTestSprites();
 	cout << "Got " << sprites.size() << " sprites" << endl;
@@ -166,10 +179,14 @@ int main(int argc, char *argv[]) {
 	}
 
 
-	mmoRenderer = make_unique<SpriteRenderer<>>(
+	mmoRenderer = make_unique<Renderer>(
 			windowWidth,
-			windowHeight,
-			rgbToARGB8888);
+			windowHeight);
+
+	for (vector<uint32_t>& frameBuffer: frameBuffers) {
+		frameBuffer.resize(windowWidth * windowHeight);
+	}
+	renderedFrame = mmoRenderer->renderAsync(sprites, (uint8_t *)frameBuffers[presentedFrame].data(), windowWidth * sizeof(uint32_t));
 
 	lastTime = SDL_GetTicks();
 	frameCount = 0;
@@ -179,13 +196,8 @@ int main(int argc, char *argv[]) {
 			break;
 		}
 
-
-		void *pixels;
-		int pitch;
-		if (SDL_LockTexture(sdlTexture, nullptr, &pixels, &pitch)) {
-			printSDLErr("SDL_LockTexture failed");
-			break;
-		}
+		//Wait for the frame that was started last time, then immediately start the next one.
+		renderedFrame.get();
 
 		//TODO: Actually render stuff?
 		for (Sprite& sprite: sprites) {
@@ -195,9 +207,13 @@ int main(int argc, char *argv[]) {
 			if (pos.x > windowWidth) pos.x = 0;
 			if (pos.y > windowHeight) pos.y = 0;
 		}
-		mmoRenderer->render(sprites, (uint8_t *)pixels, pitch);
+		renderedFrame = mmoRenderer->renderAsync(sprites, (uint8_t *)frameBuffers[1 - presentedFrame].data(), windowWidth * sizeof(uint32_t));
 
-		SDL_UnlockTexture(sdlTexture);
+		if (SDL_UpdateTexture(sdlTexture, nullptr, frameBuffers[presentedFrame].data(), windowWidth * sizeof(uint32_t))) {
+			printSDLErr("SDL_UpdateTexture failed");
+			break;
+		}
+		presentedFrame = 1 - presentedFrame;
 
 		//Blit the texture to the screen
 		if (SDL_RenderClear(sdlRenderer)) {
@@ -226,6 +242,8 @@ int main(int argc, char *argv[]) {
 
 
 cleanup:
+	//The renderer may still be rendering into one of the frame buffers.
+	if (renderedFrame.valid()) renderedFrame.wait();
 	if (sdlTexture) SDL_DestroyTexture(sdlTexture);
 	if (sdlRenderer) SDL_DestroyRenderer(sdlRenderer);
 	if (sdlWindow) SDL_DestroyWindow(sdlWindow);